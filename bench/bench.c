@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xscjson.h"
+
+/* 用法：./bench [file.json]，不指定文件时生成一份包含各种类型的测试数据 */
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static char* read_file(const char* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = (char*)malloc(*len + 1);
+    *len = fread(buf, 1, *len, fp);
+    buf[*len] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static char* generate(size_t records, size_t* len) {
+    size_t cap = records * 256 + 16, n = 0;
+    char* buf = (char*)malloc(cap);
+    n += sprintf(buf + n, "[");
+    for (size_t i = 0; i < records; i ++) {
+        n += sprintf(buf + n, "%s{\"id\":%zu,\"name\":\"user%zu\",\"score\":%.6f,\"active\":%s,"
+            "\"tags\":[\"a\",\"bb\",\"ccc\"],\"pos\":{\"x\":%.3f,\"y\":%.3f},\"note\":null}",
+            i ? "," : "", i, i, i * 0.37, i % 2 ? "true" : "false", i * 1.25, i * -0.5);
+    }
+    n += sprintf(buf + n, "]");
+    *len = n;
+    return buf;
+}
+
+static int count_bytes(void* ud, const char* data, size_t len) {
+    *(size_t*)ud += len;
+    return data != NULL;
+}
+
+/* 重复执行至少0.5秒，取最快的一次：机器上其他负载造成的抖动比相邻两行的差别还大，平均值会让结果颠倒 */
+#define BENCH(name, bytes, body)\
+    do {\
+        double start = now(), best = 1e30, t, end;\
+        do {\
+            t = now();\
+            body;\
+            end = now();\
+            if (end - t < best) {\
+                best = end - t;\
+            }\
+        } while (end - start < 0.5);\
+        printf("%-21s %8.4f ms", name, best * 1000);\
+        if ((bytes) > 0) {\
+            printf(" %8.1f MB/s", (bytes) / best / 1e6);\
+        }\
+        printf("\n");\
+    } while(0)
+
+int main(int argc, char* argv[]) {
+    size_t len, clen, slen;
+    char* json = argc > 1 ? read_file(argv[1], &len) : generate(100000, &len);
+    if (json == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    json_value v;
+    json_init(&v);
+    if (json_parse_n(&v, json, len) != JSON_PARSE_OK) {
+        fprintf(stderr, "invalid json\n");
+        return 1;
+    }
+    size_t flen;
+    char* cbor = json_to_cbor(&v, &clen);
+    char* flat = json_flat_build(&v, &flen);
+    printf("json %zu bytes, cbor %zu bytes, flat %zu bytes\n", len, clen, flen);
+
+    BENCH("json_parse", len, { json_value t; json_parse_n(&t, json, len); json_free(&t); });
+    json_set_engine(JSON_ENGINE_INDEXED);
+    BENCH("json_parse indexed", len, { json_value t; json_parse_n(&t, json, len); json_free(&t); });
+    json_set_engine(JSON_ENGINE_RECURSIVE);
+    /* 缩进格式的文档空白多，索引引擎按索引直接跳过空白 */
+    size_t ilen;
+    char* indented = json_stringify_ex(&v, &ilen, 0, 4);
+    BENCH("parse indented", ilen, { json_value t; json_parse_n(&t, indented, ilen); json_free(&t); });
+    json_set_engine(JSON_ENGINE_INDEXED);
+    BENCH("indented indexed", ilen, { json_value t; json_parse_n(&t, indented, ilen); json_free(&t); });
+    json_set_engine(JSON_ENGINE_RECURSIVE);
+    json_free_buffer(indented);
+    /* 延迟解析只做语法检查和最外层，不访问内容 */
+    BENCH("json_parse_lazy", len, { json_value t; json_parse_lazy(&t, json, len); json_free(&t); });
+    BENCH("json_stringify", len, { json_free_buffer(json_stringify(&v, &slen)); });
+    BENCH("stringify presize", len, { json_free_buffer(json_stringify_ex(&v, &slen, JSON_STRINGIFY_PRESIZE, 0)); });
+    BENCH("stringify sorted", len, { json_free_buffer(json_stringify_ex(&v, &slen, JSON_STRINGIFY_SORT_KEYS, 0)); });
+    BENCH("stringify indent", len, { json_free_buffer(json_stringify_ex(&v, &slen, 0, 2)); });
+    BENCH("json_stringify_to", len, { slen = 0; json_stringify_to(&v, count_bytes, &slen); });
+    BENCH("json_from_cbor", clen, { json_value t; json_from_cbor(&t, cbor, clen); json_free(&t); });
+    BENCH("json_to_cbor", clen, { json_free_buffer(json_to_cbor(&v, &slen)); });
+    BENCH("json_flat_build", flen, { json_free_buffer(json_flat_build(&v, &slen)); });
+    /* 平坦格式打开不需要解析，只做一遍边界检查；查找是二分查找 */
+    size_t records = 0;
+    BENCH("json_flat_open", flen, { json_flat f; records += json_flat_open(&f, flat, flen) == JSON_PARSE_OK; });
+    BENCH("flat open+find", 0, {
+        json_flat f;
+        json_flat_open_unchecked(&f, flat, flen);
+        if (json_flat_get_type(f) == JSON_ARRAY && json_flat_get_array_size(f) > 0) {
+            f = json_flat_get_array_element(f, json_flat_get_array_size(f) / 2);
+            records += json_flat_get_type(f) == JSON_OBJECT && json_flat_find_object_value(f, "id", 2).slot != NULL;
+        }
+    });
+    (void)records;
+
+    /* 2KB左右的小文档：每次调用都重新分配解析栈/输出缓冲区，与复用json_parser/json_writer对比 */
+    size_t small_len;
+    char* small = generate(10, &small_len);
+    json_value sv;
+    json_parse_n(&sv, small, small_len);
+    json_parser parser;
+    json_writer writer;
+    json_parser_init(&parser);
+    json_writer_init(&writer);
+    BENCH("small parse x1000", small_len * 1000, {
+        for (int i = 0; i < 1000; i ++) { json_value t; json_parse_n(&t, small, small_len); json_free(&t); }
+    });
+    BENCH("json_parser x1000", small_len * 1000, {
+        for (int i = 0; i < 1000; i ++) { json_value t; json_parser_parse(&parser, &t, small, small_len, NULL); json_free(&t); }
+    });
+    BENCH("small stringify x1000", small_len * 1000, {
+        for (int i = 0; i < 1000; i ++) { json_free_buffer(json_stringify(&sv, &slen)); }
+    });
+    BENCH("json_writer x1000", small_len * 1000, {
+        for (int i = 0; i < 1000; i ++) { json_writer_stringify(&writer, &sv, &slen, 0, 0); }
+    });
+    json_writer_free(&writer);
+    json_parser_free(&parser);
+    json_free(&sv);
+    free(small);
+
+    json_free_buffer(flat);
+    json_free_buffer(cbor);
+    json_free(&v);
+    free(json);
+    return 0;
+}
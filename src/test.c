@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include "xscjson.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
 
 static int main_ret = 0;
 static int test_count = 0;
@@ -26,6 +29,8 @@ static int test_pass = 0;
     EXPECT_EQ_BASE(sizeof(expect) - 1 == (alength) && memcmp(expect, actual, alength) == 0, expect, actual, "%s")
 #define EXPECT_EQ_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
 #define EXPECT_EQ_FALSE(actual) EXPECT_EQ_BASE((actual) == 0, "false", "true", "%s")
+#define EXPECT_EQ_INT64(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (long long)(expect), (long long)(actual), "%lld")
+#define EXPECT_EQ_UINT64(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (unsigned long long)(expect), (unsigned long long)(actual), "%llu")
 #define EXPECT_EQ_SIZE_T(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (size_t)expect, (size_t)actual, "%zu")
 
 static void test_parse_null() {
@@ -93,8 +98,87 @@ static void test_parse_number() {
     TEST_NUMBER(-2.2250738585072014e-308, "-2.2250738585072014e-308");
     TEST_NUMBER( 1.7976931348623157e+308, "1.7976931348623157e+308");  /* Max double */
     TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
+    // 快速路径和慢速路径的分界
+    TEST_NUMBER(0.1, "0.1");
+    TEST_NUMBER(1e22, "1e22");
+    TEST_NUMBER(1e23, "1e23");
+    TEST_NUMBER(1e-22, "1e-22");
+    TEST_NUMBER(9007199254740992.0, "9007199254740992");
+    TEST_NUMBER(9007199254740993.0, "9007199254740993");
+    TEST_NUMBER(0.0, "-0e100");
+    TEST_NUMBER(1.2345678901234567e+29, "123456789012345678901234567890");
+    TEST_NUMBER(0.12345678901234568, "0.12345678901234567890123");
+    // 慢速路径需要正确舍入：恰好在两个double中点上的数舍入到偶数，略大一点就进位
+    TEST_NUMBER(9007199254740992.0, "9007199254740993.0");
+    TEST_NUMBER(9007199254740994.0, "9007199254740993.0000000000000000001");
+    TEST_NUMBER(1.0, "1.00000000000000011102230246251565404236316680908203125");
+    TEST_NUMBER(1.0000000000000002, "1.00000000000000011102230246251565404236316680908203126");
+    TEST_NUMBER(2.225073858507201e-308, "2.2250738585072011e-308");
+    TEST_NUMBER(0.0, "2.4703282292062327e-324"); /* 略小于最小非规格化数的一半 */
+    TEST_NUMBER(4.9406564584124654e-324, "2.4703282292062328e-324");
+    TEST_NUMBER(1.7976931348623157e+308, "1.7976931348623158e+308");
+    TEST_NUMBER(1.7976931348623157e+308, "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791");
+    TEST_NUMBER(5e-324, "0.0000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000049406564584124654");
+    {
+        // 超过768位有效数字的部分只记录是否为0，中点之后很远的一位非零数字仍然决定进位
+        static const char half[] = "1.00000000000000011102230246251565404236316680908203125";
+        char buf[sizeof(half) + 1000];
+        json_value v;
+        memcpy(buf, half, sizeof(half) - 1);
+        memset(buf + sizeof(half) - 1, '0', 998);
+        strcpy(buf + sizeof(half) - 1 + 998, "1");
+        json_init(&v);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, buf));
+        EXPECT_EQ_DOUBLE(1.0000000000000002, json_get_number(&v));
+        buf[sizeof(half) - 1 + 998] = '\0';
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, buf));
+        EXPECT_EQ_DOUBLE(1.0, json_get_number(&v));
+        json_free(&v);
+    }
 }
 
+#define TEST_INTEGER(expect, json)\
+    do {\
+        json_value v;\
+        json_init(&v);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));\
+        EXPECT_EQ_INT(JSON_NUMBER, json_get_type(&v));\
+        EXPECT_EQ_TRUE(json_is_integer(&v));\
+        EXPECT_EQ_INT64(expect, json_get_int64(&v));\
+        json_free(&v);\
+    } while(0)
+
+#define TEST_NOT_INTEGER(json)\
+    do {\
+        json_value v;\
+        json_init(&v);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));\
+        EXPECT_EQ_INT(JSON_NUMBER, json_get_type(&v));\
+        EXPECT_EQ_FALSE(json_is_integer(&v));\
+        json_free(&v);\
+    } while(0)
+
+static void test_parse_integer() {
+    json_value v;
+    TEST_INTEGER(0, "0");
+    TEST_INTEGER(-1, "-1");
+    TEST_INTEGER(9007199254740993LL, "9007199254740993"); /* 2^53 + 1 */
+    TEST_INTEGER(INT64_MAX, "9223372036854775807");
+    TEST_INTEGER(INT64_MIN, "-9223372036854775808");
+    TEST_NOT_INTEGER("-0");
+    TEST_NOT_INTEGER("1.0");
+    TEST_NOT_INTEGER("1e2");
+    TEST_NOT_INTEGER("-9223372036854775809");
+    TEST_NOT_INTEGER("18446744073709551616");
+
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, "18446744073709551615"));
+    EXPECT_EQ_TRUE(json_is_integer(&v));
+    EXPECT_EQ_UINT64(UINT64_MAX, json_get_uint64(&v));
+    EXPECT_EQ_INT64(INT64_MAX, json_get_int64(&v));
+    EXPECT_EQ_DOUBLE(18446744073709551615.0, json_get_number(&v));
+    json_free(&v);
+}
 
 #define TEST_STRING(expect, json)\
     do {\
@@ -121,6 +205,36 @@ static void test_parse_string() {
     TEST_STRING("\xF0\x9D\x84\x9E", "\"\\ud834\\udd1e\"");  /* G clef sign U+1D11E */
 }
 
+static void test_parse_long_string() {
+    /* 特殊字符出现在分块扫描的各个位置 */
+    char json[80], expect[80];
+    json_value v;
+    for (size_t n = 2; n < 70; n ++) {
+        for (size_t i = 0; i + 1 < n; i ++) {
+            json[0] = '\"';
+            memset(json + 1, 'a', n);
+            memset(expect, 'a', n);
+            json[1 + i] = '\\';
+            json[2 + i] = 'n';
+            json[n + 1] = '\"';
+            json[n + 2] = '\0';
+            expect[i] = '\n';
+            json_init(&v);
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+            EXPECT_EQ_SIZE_T(n - 1, json_get_string_length(&v));
+            EXPECT_EQ_TRUE(memcmp(expect, json_get_string(&v), n - 1) == 0);
+            json_free(&v);
+
+            json[1 + i] = '\x1f';
+            json[2 + i] = 'a';
+            EXPECT_EQ_INT(JSON_PARSE_INVALID_STRING_CHAR, json_parse(&v, json));
+            json[n + 1] = '\0';
+            json[1 + i] = 'a';
+            EXPECT_EQ_INT(JSON_PARSE_MISS_QUOTATION_MARK, json_parse(&v, json));
+        }
+    }
+}
+
 static void test_parse_array() {
     json_value v;
     json_init(&v);
@@ -259,6 +373,9 @@ static void test_parse_root_not_singular() {
 static void test_parse_number_too_big() {
     TEST_ERROR(JSON_PARSE_NUMBER_TOO_BIG, "1e309");
     TEST_ERROR(JSON_PARSE_NUMBER_TOO_BIG, "-1e309");
+    TEST_ERROR(JSON_PARSE_NUMBER_TOO_BIG, "1.7976931348623159e+308");
+    /* 正好是DBL_MAX和2^1024的中点，舍入到偶数即溢出 */
+    TEST_ERROR(JSON_PARSE_NUMBER_TOO_BIG, "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792");
 }
 static void test_parse_missing_quotation_mark() {
     TEST_ERROR(JSON_PARSE_MISS_QUOTATION_MARK, "\"");
@@ -325,12 +442,805 @@ static void test_parse_miss_comma_or_curly_bracket() {
     TEST_ERROR(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+#define TEST_ERROR_N(error, json, len)\
+    do {\
+        json_value v;\
+        json_init(&v);\
+        v.type = JSON_FALSE;\
+        EXPECT_EQ_INT(error, json_parse_n(&v, json, len));\
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));\
+        json_free(&v);\
+    } while(0)
+
+static void test_parse_n() {
+    json_value v;
+    /* 只解析切片，不读取之后的字节 */
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, "1234", 2));
+    EXPECT_EQ_DOUBLE(12.0, json_get_number(&v));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, "[1,2]]", 5));
+    EXPECT_EQ_SIZE_T(2, json_get_array_size(&v));
+    json_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, "\"a\\u0000b\"xyz", 10));
+    EXPECT_EQ_STRING("a\0b", json_get_string(&v), json_get_string_length(&v));
+    json_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, "truex", 4));
+    EXPECT_EQ_INT(JSON_TRUE, json_get_type(&v));
+    json_free(&v);
+
+    TEST_ERROR_N(JSON_PARSE_EXPECT_VALUE, "null", 0);
+    TEST_ERROR_N(JSON_PARSE_INVALID_VALUE, "null", 3);
+    TEST_ERROR_N(JSON_PARSE_INVALID_VALUE, "1.5", 2);
+    TEST_ERROR_N(JSON_PARSE_INVALID_VALUE, "1e5", 2);
+    TEST_ERROR_N(JSON_PARSE_MISS_QUOTATION_MARK, "\"abc\"", 4);
+    TEST_ERROR_N(JSON_PARSE_INVALID_UNICODE_HEX, "\"\\u0041\"", 5);
+    TEST_ERROR_N(JSON_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uD834\\uDD1E\"", 8);
+    TEST_ERROR_N(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1,2]", 4);
+    TEST_ERROR_N(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1}", 6);
+    /* 字符串中的'\0'是非法字符，而不是输入结束 */
+    TEST_ERROR_N(JSON_PARSE_INVALID_STRING_CHAR, "\"a\0b\"", 5);
+    TEST_ERROR_N(JSON_PARSE_ROOT_NOT_SINGULAR, "1\0", 2);
+    TEST_ERROR_N(JSON_PARSE_INVALID_VALUE, "\0", 1);
+}
+
+static void test_parse_arena() {
+    json_arena a;
+    json_value v, *e;
+    json_arena_init(&a, 64);
+    for (int round = 0; round < 2; round ++) { // reset之后复用同一个arena
+        json_init(&v);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_arena(&v,
+            "{\"s\":\"Hello\\nWorld\",\"a\":[1,\"abc\",[],{}],\"o\":{\"k\":true}}", &a));
+        EXPECT_EQ_INT(JSON_OBJECT, json_get_type(&v));
+        EXPECT_EQ_SIZE_T(3, json_get_object_size(&v));
+        e = json_find_object_value(&v, "s", 1);
+        EXPECT_EQ_STRING("Hello\nWorld", json_get_string(e), json_get_string_length(e));
+        e = json_find_object_value(&v, "a", 1);
+        EXPECT_EQ_SIZE_T(4, json_get_array_size(e));
+        EXPECT_EQ_STRING("abc", json_get_string(json_get_array_element(e, 1)), json_get_string_length(json_get_array_element(e, 1)));
+        EXPECT_EQ_INT(JSON_TRUE, json_get_type(json_find_object_value(json_find_object_value(&v, "o", 1), "k", 1)));
+        json_arena_reset(&a);
+    }
+
+    /* 修改arena中的值：扩容时拷贝出来，新加的成员由json_free释放 */
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_arena(&v, "{\"a\":[1,2],\"b\":\"x\"}", &a));
+    e = json_find_object_value(&v, "a", 1);
+    json_set_string(json_pushback_array_element(e), "Hello", 5);
+    EXPECT_EQ_SIZE_T(3, json_get_array_size(e));
+    json_set_string(json_find_object_value(&v, "b", 1), "World", 5);
+    json_set_number(json_set_object_value(&v, "c", 1), 3.0);
+    EXPECT_EQ_SIZE_T(3, json_get_object_size(&v));
+    EXPECT_EQ_STRING("a", json_get_object_key(&v, 0), json_get_object_key_length(&v, 0));
+    json_free(&v);
+
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_arena(&v, "[\"a\",{\"b\":[1}]", &a));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    json_arena_free(&a);
+}
+
+static void test_parse_insitu() {
+    json_value v, *e;
+    char buf[] = "{\"k\\u0041\":[\"Hello\\nWorld\", \"\\uD834\\uDD1E\", \"\"], \"n\":1}";
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_insitu(&v, buf));
+    EXPECT_EQ_INT(JSON_OBJECT, json_get_type(&v));
+    EXPECT_EQ_STRING("kA", json_get_object_key(&v, 0), json_get_object_key_length(&v, 0));
+    EXPECT_EQ_TRUE(json_get_object_key(&v, 0) > buf && json_get_object_key(&v, 0) < buf + sizeof(buf));
+    e = json_get_object_value(&v, 0);
+    EXPECT_EQ_SIZE_T(3, json_get_array_size(e));
+    EXPECT_EQ_STRING("Hello\nWorld", json_get_string(json_get_array_element(e, 0)), json_get_string_length(json_get_array_element(e, 0)));
+    EXPECT_EQ_STRING("\xF0\x9D\x84\x9E", json_get_string(json_get_array_element(e, 1)), json_get_string_length(json_get_array_element(e, 1)));
+    EXPECT_EQ_STRING("", json_get_string(json_get_array_element(e, 2)), json_get_string_length(json_get_array_element(e, 2)));
+    EXPECT_EQ_TRUE(json_get_string(json_get_array_element(e, 0)) > buf && json_get_string(json_get_array_element(e, 0)) < buf + sizeof(buf));
+    /* 原地解析出的字符串仍以'\0'结尾 */
+    EXPECT_EQ_INT('\0', json_get_string(json_get_array_element(e, 0))[json_get_string_length(json_get_array_element(e, 0))]);
+    json_set_boolean(json_set_object_value(&v, "t", 1), 1);
+    EXPECT_EQ_SIZE_T(3, json_get_object_size(&v));
+    EXPECT_EQ_STRING("kA", json_get_object_key(&v, 0), json_get_object_key_length(&v, 0));
+    json_free(&v);
+
+    char bad[] = "[\"abc\", {\"a\\n\":\"x\\q\"}]";
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_STRING_ESCAPE, json_parse_insitu(&v, bad));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+}
+
+static void test_parse_intern() {
+    json_key_pool pool;
+    json_value v1, v2, o;
+    json_key_pool_init(&pool);
+    json_init(&v1);
+    json_init(&v2);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_intern(&v1, "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"}]", &pool));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_intern(&v2, "{\"name\":\"a\",\"id\":1}", &pool));
+    EXPECT_EQ_SIZE_T(2, pool.size);
+    /* 同一个pool中相同的键共享同一份存储 */
+    EXPECT_EQ_TRUE(json_get_object_key(json_get_array_element(&v1, 0), 0) == json_get_object_key(json_get_array_element(&v1, 1), 0));
+    EXPECT_EQ_TRUE(json_get_object_key(json_get_array_element(&v1, 0), 0) == json_get_object_key(&v2, 1));
+    EXPECT_EQ_TRUE(json_get_object_key(&v2, 0) == json_key_pool_intern(&pool, "name", 4));
+    EXPECT_EQ_STRING("name", json_get_object_key(&v2, 0), json_get_object_key_length(&v2, 0));
+    EXPECT_EQ_TRUE(json_is_equal(json_get_array_element(&v1, 0), &v2));
+    EXPECT_EQ_TRUE(!json_is_equal(json_get_array_element(&v1, 1), &v2));
+
+    /* 修改：普通set会把借用的键拷贝出来，intern版本继续使用pool */
+    json_set_number(json_set_object_value(&v2, "x", 1), 1.0);
+    EXPECT_EQ_SIZE_T(3, json_get_object_size(&v2));
+    EXPECT_EQ_TRUE(json_get_object_key(&v2, 0) != json_key_pool_intern(&pool, "name", 4));
+    json_set_number(json_set_object_value_intern(&v2, "y", 1, &pool), 2.0);
+    EXPECT_EQ_SIZE_T(4, json_get_object_size(&v2));
+    EXPECT_EQ_TRUE(json_get_object_key(&v2, 0) == json_key_pool_intern(&pool, "name", 4));
+    EXPECT_EQ_STRING("x", json_get_object_key(&v2, 2), json_get_object_key_length(&v2, 2));
+    EXPECT_EQ_DOUBLE(2.0, json_get_number(json_find_object_value(&v2, "y", 1)));
+
+    json_init(&o);
+    json_set_object(&o, 0);
+    json_set_null(json_set_object_value_intern(&o, "id", 2, &pool));
+    EXPECT_EQ_TRUE(json_get_object_key(&o, 0) == json_get_object_key(&v2, 1));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_find_object_value(&o, "id", 2)));
+    json_free(&o);
+    /* 指针相同但长度不同的键不能当作同一个键 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&o, "{\"abc\":1,\"ab\":2}"));
+    EXPECT_EQ_SIZE_T(1, json_find_object_index(&o, json_get_object_key(&o, 0), 2));
+    for (int i = 0; i < 20; i ++) { /* 超过阈值之后走哈希索引 */
+        char key[8];
+        json_set_int64(json_set_object_value(&o, key, sprintf(key, "k%d", i)), i);
+    }
+    EXPECT_EQ_SIZE_T(1, json_find_object_index(&o, json_get_object_key(&o, 0), 2));
+    EXPECT_EQ_SIZE_T(0, json_find_object_index(&o, json_get_object_key(&o, 0), 3));
+    json_free(&o);
+    json_free(&v1);
+    json_free(&v2);
+
+    json_init(&v1);
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_parse_intern(&v1, "{\"a\":{\"b\" 1}}", &pool));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v1));
+    json_key_pool_free(&pool);
+}
+
+/* 把SAX事件依次记录成字符串，便于比较 */
+typedef struct {
+    char buf[256];
+    size_t len;
+    int stop_after; /* 记录这么多个事件之后返回0，负数表示不停止 */
+} sax_recorder;
+
+static void sax_append(sax_recorder* r, const char* s, size_t len) {
+    if (r->len + len < sizeof(r->buf)) {
+        memcpy(r->buf + r->len, s, len);
+        r->buf[r->len += len] = '\0';
+    }
+}
+static int sax_record(sax_recorder* r, const char* s, size_t len) {
+    sax_append(r, s, len);
+    return r->stop_after < 0 || -- r->stop_after > 0;
+}
+static int sax_null(void* ud) { return sax_record((sax_recorder*)ud, "n", 1); }
+static int sax_boolean(void* ud, int b) { return sax_record((sax_recorder*)ud, b ? "t" : "f", 1); }
+static int sax_number(void* ud, const json_value* n) {
+    char buf[32];
+    if (json_is_integer(n)) {
+        sprintf(buf, "i%lld", (long long)json_get_int64(n));
+    } else {
+        sprintf(buf, "d%g", json_get_number(n));
+    }
+    return sax_record((sax_recorder*)ud, buf, strlen(buf));
+}
+static int sax_string(void* ud, const char* s, size_t len) {
+    sax_append((sax_recorder*)ud, "s", 1);
+    return sax_record((sax_recorder*)ud, s, len);
+}
+static int sax_start_object(void* ud) { return sax_record((sax_recorder*)ud, "{", 1); }
+static int sax_key(void* ud, const char* k, size_t klen) {
+    sax_append((sax_recorder*)ud, k, klen);
+    return sax_record((sax_recorder*)ud, ":", 1);
+}
+static int sax_end_object(void* ud, size_t size) {
+    char buf[32];
+    sprintf(buf, "}%d", (int)size);
+    return sax_record((sax_recorder*)ud, buf, strlen(buf));
+}
+static int sax_start_array(void* ud) { return sax_record((sax_recorder*)ud, "[", 1); }
+static int sax_end_array(void* ud, size_t size) {
+    char buf[32];
+    sprintf(buf, "]%d", (int)size);
+    return sax_record((sax_recorder*)ud, buf, strlen(buf));
+}
+
+static const json_sax_handler sax_recorder_handler = {
+    sax_null, sax_boolean, sax_number, sax_string,
+    sax_start_object, sax_key, sax_end_object, sax_start_array, sax_end_array
+};
+
+#define TEST_SAX(expect_ret, expect, json, stop)\
+    do {\
+        sax_recorder r;\
+        r.len = 0;\
+        r.buf[0] = '\0';\
+        r.stop_after = stop;\
+        EXPECT_EQ_INT(expect_ret, json_sax_parse(json, strlen(json), &sax_recorder_handler, &r));\
+        EXPECT_EQ_STRING(expect, r.buf, strlen(r.buf));\
+    } while(0)
+
+static void test_parse_sax() {
+    TEST_SAX(JSON_PARSE_OK, "n", " null ", -1);
+    TEST_SAX(JSON_PARSE_OK, "sHello\nWorld", "\"Hello\\nWorld\"", -1);
+    TEST_SAX(JSON_PARSE_OK, "[]0", "[ ]", -1);
+    TEST_SAX(JSON_PARSE_OK, "{}0", "{ }", -1);
+    TEST_SAX(JSON_PARSE_OK, "[i1d1.5tfn[]0{}0sabc]8", "[1, 1.5, true, false, null, [], {}, \"abc\"]", -1);
+    TEST_SAX(JSON_PARSE_OK, "{a:[i-2[sx]1]2b:{c:d1e+20}1}2",
+        "{\"a\":[-2,[\"x\"]],\"b\":{\"c\":1e20}}", -1);
+
+    /* 回调返回0时立即停止 */
+    TEST_SAX(JSON_PARSE_STOPPED, "[i1", "[1, 2, 3]", 2);
+    TEST_SAX(JSON_PARSE_STOPPED, "{a:", "{\"a\":1}", 2);
+    TEST_SAX(JSON_PARSE_STOPPED, "[", "[1]", 1);
+
+    /* 错误之前的事件已经产生 */
+    TEST_SAX(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[i1i2", "[1, 2 3]", -1);
+    TEST_SAX(JSON_PARSE_MISS_COLON, "{a:", "{\"a\" 1}", -1);
+    TEST_SAX(JSON_PARSE_ROOT_NOT_SINGULAR, "n", "null x", -1);
+    TEST_SAX(JSON_PARSE_INVALID_STRING_ESCAPE, "[", "[\"\\q\"]", -1);
+
+    /* 不关心的事件可以设为NULL */
+    json_sax_handler h;
+    memset(&h, 0, sizeof(h));
+    h.number = sax_number;
+    sax_recorder r;
+    r.len = 0;
+    r.stop_after = -1;
+    const char* json = "{\"a\":[1,\"b\",{\"c\":2}],\"d\":3}";
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_sax_parse(json, strlen(json), &h, &r));
+    EXPECT_EQ_STRING("i1i2i3", r.buf, r.len);
+}
+
+/* 把json按split切成两块(split为0时逐字节)流式解析，结果和错误码都应与json_parse_n相同 */
+static void test_stream_split(const char* json, size_t split) {
+    json_value expect, v;
+    size_t len = strlen(json);
+    int ret = json_parse_n(&expect, json, len);
+    json_stream* s = json_stream_new(&v);
+    int sret = JSON_PARSE_OK;
+    if (split == 0) {
+        for (size_t i = 0; i < len && sret == JSON_PARSE_OK; i ++) {
+            sret = json_stream_feed(s, json + i, 1);
+        }
+    } else {
+        sret = json_stream_feed(s, json, split);
+        if (sret == JSON_PARSE_OK) {
+            sret = json_stream_feed(s, json + split, len - split);
+        }
+    }
+    if (sret == JSON_PARSE_OK) {
+        sret = json_stream_finish(s);
+    }
+    json_stream_free(s);
+    EXPECT_EQ_INT(ret, sret);
+    if (ret == JSON_PARSE_OK) {
+        EXPECT_EQ_TRUE(json_is_equal(&expect, &v));
+        json_free(&v);
+    } else {
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    }
+    json_free(&expect);
+}
+
+static void test_parse_stream() {
+    static const char* jsons[] = {
+        "null", " true ", "false", "0", "-0.0", "123", "-1.5e-10", "1E+2", "18446744073709551615",
+        "\"\"", "\"Hello\\nWorld\"", "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\uD834\\uDD1E\\u00A2\"",
+        "[ ]", "{ }", "[ null , false , true , 123 , \"abc\" ]",
+        "[ [ ] , [ 0 ] , [ 0 , 1 ] , [ 0 , 1 , 2 ] ]",
+        " { \"n\" : null , \"f\" : false , \"t\" : true , \"i\" : 123 , \"s\" : \"abc\", "
+        " \"a\" : [ 1, 2, 3 ], \"o\" : { \"1\" : 1, \"2\" : 2, \"3\" : 3 } } ",
+        "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8,"
+        "\"i\":9,\"j\":10,\"k\":11,\"l\":12,\"m\":13,\"n\":14,\"o\":15,\"p\":16,\"q\":[{}]}",
+        /* 错误 */
+        "", " ", "nul", "nulx", "?", "+1", ".123", "1.", "1e", "-", "inf", "[1,]", "[\"a\", nul]",
+        "null x", "0123", "0x0", "1-2", "[01]", "{\"a\":01}", "1e309",
+        "\"", "\"abc", "\"\\v\"", "\"\x01\"", "\"\\u012\"", "\"\\u01", "\"\\uD800\"", "\"\\uD800\\uE000\"", "\"\\",
+        "[", "[1", "[1}", "[1 2", "[[]", "{", "{:1,", "{1:1,", "{\"a\":1,", "{\"a\"}", "{\"a\"", "{\"a\":",
+        "{\"a\":1", "{\"a\":1]", "{\"a\":{}", "[{\"a\":[1,{\"b\":\"x\\q\"}]}]"
+    };
+    for (size_t i = 0; i < sizeof(jsons) / sizeof(jsons[0]); i ++) {
+        size_t len = strlen(jsons[i]);
+        for (size_t split = 0; split <= len; split ++) {
+            test_stream_split(jsons[i], split);
+        }
+    }
+
+    /* SAX模式：事件与json_sax_parse相同 */
+    const char* json = "{\"a\":[-2,[\"x\"]],\"b\":{\"c\":1e20}}";
+    sax_recorder r;
+    r.len = 0;
+    r.stop_after = -1;
+    json_stream* s = json_stream_new_sax(&sax_recorder_handler, &r);
+    for (const char* p = json; *p != '\0'; p ++) {
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_feed(s, p, 1));
+    }
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_finish(s));
+    json_stream_free(s);
+    EXPECT_EQ_STRING("{a:[i-2[sx]1]2b:{c:d1e+20}1}2", r.buf, r.len);
+
+    r.len = 0;
+    r.stop_after = 3;
+    s = json_stream_new_sax(&sax_recorder_handler, &r);
+    EXPECT_EQ_INT(JSON_PARSE_STOPPED, json_stream_feed(s, "[1, [2, 3]]", 11));
+    EXPECT_EQ_INT(JSON_PARSE_STOPPED, json_stream_finish(s)); /* 出错之后保持同一个错误码 */
+    json_stream_free(s);
+    EXPECT_EQ_STRING("[i1[", r.buf, r.len);
+
+    /* 不调用finish直接释放，未完成的树也要释放 */
+    json_value v;
+    s = json_stream_new(&v);
+    json = "[\"abc\", {\"k\": [1, \"x";
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_feed(s, json, strlen(json)));
+    json_stream_free(s);
+}
+
+typedef struct {
+    size_t records, errors, last_line, first_error_line;
+    int ordered, stop_at;
+    double sum;
+} ndjson_counter;
+
+static int ndjson_count(void* ud, size_t line, int ret, json_value* v) {
+    ndjson_counter* n = (ndjson_counter*)ud;
+    n->ordered &= line > n->last_line;
+    n->last_line = line;
+    n->records ++;
+    if (ret != JSON_PARSE_OK) {
+        if (n->errors ++ == 0) {
+            n->first_error_line = line;
+        }
+        n->ordered &= json_get_type(v) == JSON_NULL;
+    } else {
+        n->sum += json_get_number(json_find_object_value(v, "i", 1));
+    }
+    return n->stop_at == 0 || n->records < (size_t)n->stop_at;
+}
+
+static void test_parse_ndjson() {
+    size_t lines = 3000, len = 0;
+    char* json = (char*)malloc(lines * 48);
+    double sum = 0.0;
+    for (size_t i = 1; i <= lines; i ++) {
+        if (i % 100 == 0) {
+            len += sprintf(json + len, " \r\n");                /* 空行 */
+        } else if (i % 700 == 699) {
+            len += sprintf(json + len, "{\"i\":%d,}\n", (int)i); /* 错误 */
+        } else {
+            len += sprintf(json + len, "{\"i\":%d,\"s\":\"line\\n%d\"}%s\n", (int)i, (int)i, i % 2 ? "\r" : "");
+            sum += i;
+        }
+    }
+    len --; /* 最后一行没有换行符 */
+    for (unsigned threads = 0; threads <= 4; threads ++) {
+        ndjson_counter n;
+        memset(&n, 0, sizeof(n));
+        n.ordered = 1;
+        EXPECT_EQ_INT(JSON_PARSE_MISS_KEY, json_parse_ndjson(json, len, threads, ndjson_count, &n));
+        EXPECT_EQ_TRUE(n.ordered);
+        EXPECT_EQ_SIZE_T(lines - 30, n.records);
+        EXPECT_EQ_SIZE_T(4, n.errors);
+        EXPECT_EQ_SIZE_T(699, n.first_error_line);
+        EXPECT_EQ_SIZE_T(lines - 1, n.last_line);
+        EXPECT_EQ_DOUBLE(sum, n.sum);
+    }
+
+    ndjson_counter n;
+    memset(&n, 0, sizeof(n));
+    n.ordered = 1;
+    n.stop_at = 10;
+    EXPECT_EQ_INT(JSON_PARSE_STOPPED, json_parse_ndjson(json, len, 4, ndjson_count, &n));
+    EXPECT_EQ_SIZE_T(10, n.records);
+    EXPECT_EQ_SIZE_T(10, n.last_line);
+
+    memset(&n, 0, sizeof(n));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ndjson("\n\n", 2, 2, ndjson_count, &n));
+    EXPECT_EQ_SIZE_T(0, n.records);
+    free(json);
+}
+
+static void test_parse_lazy() {
+    const char* json = " { \"a\" : [ 1, \"x\\ty\", { \"b\" : [ [ ] , { } ] } ], \"s\" : \"Hello\\u0020World\", \"n\" : -1.5, \"t\" : true } ";
+    json_value v, e, *p;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, json, strlen(json)));
+    EXPECT_EQ_INT(JSON_OBJECT, json_get_type(&v));
+    EXPECT_EQ_SIZE_T(4, json_get_object_size(&v));
+    /* 数组、对象、字符串在访问之前只有类型 */
+    p = json_find_object_value(&v, "a", 1);
+    EXPECT_EQ_INT(JSON_ARRAY, json_get_type(p));
+    EXPECT_EQ_INT(JSON_STRING, json_get_type(json_find_object_value(&v, "s", 1)));
+    EXPECT_EQ_DOUBLE(-1.5, json_get_number(json_find_object_value(&v, "n", 1)));
+    EXPECT_EQ_SIZE_T(3, json_get_array_size(p));
+    EXPECT_EQ_STRING("x\ty", json_get_string(json_get_array_element(p, 1)), json_get_string_length(json_get_array_element(p, 1)));
+    p = json_find_object_value(json_get_array_element(p, 2), "b", 1);
+    EXPECT_EQ_SIZE_T(2, json_get_array_size(p));
+    EXPECT_EQ_SIZE_T(0, json_get_object_size(json_get_array_element(p, 1)));
+    /* 只访问了一部分就释放 */
+    json_free(&v);
+
+    /* 只读访问不改写值本身，解析结果缓存在单独的单元中；修改时再移回值本身 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, "[\"a\",[1]]", 9));
+    memcpy(&e, &v, sizeof(json_value));
+    p = json_get_array_element(&v, 1);
+    EXPECT_EQ_SIZE_T(1, json_get_array_size(p));
+    EXPECT_EQ_STRING("a", json_get_string(json_get_array_element(&v, 0)), 1);
+    EXPECT_EQ_TRUE(memcmp(&e, &v, sizeof(json_value)) == 0);
+    json_set_null(json_pushback_array_element(&v));
+    EXPECT_EQ_SIZE_T(3, json_get_array_size(&v));
+    EXPECT_EQ_SIZE_T(1, json_get_array_size(json_get_array_element(&v, 1)));
+    json_clear_array(json_get_array_element(&v, 1));
+    EXPECT_EQ_SIZE_T(0, json_get_array_size(json_get_array_element(&v, 1)));
+    json_free(&v);
+
+    /* 比较、拷贝、生成的结果与完整解析相同 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, json, strlen(json)));
+    json_init(&e);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, json));
+    EXPECT_EQ_TRUE(json_is_equal(&v, &e));
+    json_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, json, strlen(json)));
+    size_t len1, len2;
+    char* s1 = json_stringify(&v, &len1);
+    char* s2 = json_stringify(&e, &len2);
+    EXPECT_EQ_SIZE_T(len2, len1);
+    EXPECT_EQ_TRUE(memcmp(s1, s2, len1) == 0);
+    json_free_buffer(s1);
+    json_free_buffer(s2);
+    json_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, json, strlen(json)));
+    json_value c;
+    json_init(&c);
+    json_copy(&c, &v);
+    EXPECT_EQ_TRUE(json_is_equal(&c, &e));
+    json_free(&c);
+    json_free(&e);
+
+    /* 修改延迟的值 */
+    json_set_number(json_pushback_array_element(json_find_object_value(&v, "a", 1)), 2.0);
+    EXPECT_EQ_SIZE_T(4, json_get_array_size(json_find_object_value(&v, "a", 1)));
+    json_set_string(json_find_object_value(&v, "s", 1), "abc", 3);
+    json_remove_object_value(&v, json_find_object_index(&v, "t", 1));
+    EXPECT_EQ_SIZE_T(3, json_get_object_size(&v));
+    json_free(&v);
+
+    /* 根节点是标量或字符串 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, " 123 ", 5));
+    EXPECT_EQ_DOUBLE(123.0, json_get_number(&v));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, "\"\\\"\"", 4));
+    EXPECT_EQ_STRING("\"", json_get_string(&v), json_get_string_length(&v));
+    json_free(&v);
+
+    /* 语法错误在解析时就报告 */
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_lazy(&v, "[[1], [2}]", 10));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_STRING_ESCAPE, json_parse_lazy(&v, "{\"a\":\"\\x\"}", 10));
+    EXPECT_EQ_INT(JSON_PARSE_ROOT_NOT_SINGULAR, json_parse_lazy(&v, "[] []", 5));
+    /* 语法检查不解码字符串、不转换数字，错误码仍与完整解析相同 */
+    static const char* invalid[] = {
+        "", " ", "[", "{", "[1,]", "[,1]", "[1 2]", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{1:1}", "{\"a\":1 \"b\":2}",
+        "[nul]", "[tru]", "[-]", "[01]", "[1.]", "[1e]", "[.5]", "[1e309]", "[-1e309]", "[0.5e309]", "[1e-400]", "{\"a\":[1E+400]}",
+        "[\"a]", "[\"\\v\"]", "[\"\\u12G4\"]", "[\"\\uD800\"]", "[\"\\uD800\\u0041\"]", "[\"\\uDBFF\\uDFFF\"]", "[\"\x01\"]",
+        "[[[]]", "[{}}", "{\"a\":[}", "[] x", "[1]]", "[\"\\u00e9\",{\"k\":[true,false,null,-0.5e-3]}]"
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i ++) {
+        int expect = json_parse_n(&e, invalid[i], strlen(invalid[i]));
+        json_free(&e);
+        EXPECT_EQ_INT(expect, json_parse_lazy(&v, invalid[i], strlen(invalid[i])));
+        json_free(&v);
+    }
+    char big[400];
+    memset(big, '9', sizeof(big));
+    big[0] = '[';
+    big[sizeof(big) - 1] = ']';
+    EXPECT_EQ_INT(JSON_PARSE_NUMBER_TOO_BIG, json_parse_lazy(&v, big, sizeof(big)));
+    big[299] = ']'; /* 298位整数 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_lazy(&v, big, 300));
+    json_free(&v);
+}
+
+#define TEST_SKIP(error, expect_skipped, json)\
+    do {\
+        size_t skipped = 123;\
+        EXPECT_EQ_INT(error, json_skip_value(json, strlen(json), &skipped));\
+        EXPECT_EQ_SIZE_T(expect_skipped, skipped);\
+    } while(0)
+
+static void test_parse_skip() {
+    TEST_SKIP(JSON_PARSE_OK, 5, " null , 1");
+    TEST_SKIP(JSON_PARSE_OK, 4, "-1.5]");
+    TEST_SKIP(JSON_PARSE_OK, 6, "\"a\\\"b\",");
+    TEST_SKIP(JSON_PARSE_OK, 2, "[]");
+    TEST_SKIP(JSON_PARSE_OK, 50, "  { \"a\" : [ 1, \"]}\\\\\", { \"b\" : [ [ ] , { } ] } ] } ,\"c\":2}");
+    /* 超过一个SIMD块的数组 */
+    TEST_SKIP(JSON_PARSE_OK, 68, "[\"0123456789012345678901234567890123456789\", [0, 1, 2, 3, 4, 5, {}]]  ");
+
+    TEST_SKIP(JSON_PARSE_EXPECT_VALUE, 0, " ");
+    TEST_SKIP(JSON_PARSE_INVALID_VALUE, 0, "nul");
+    TEST_SKIP(JSON_PARSE_MISS_QUOTATION_MARK, 0, "\"abc");
+    TEST_SKIP(JSON_PARSE_MISS_QUOTATION_MARK, 0, "[\"abc\\");
+    TEST_SKIP(JSON_PARSE_INVALID_STRING_CHAR, 0, "[\"a\tb\"]");
+    TEST_SKIP(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 0, "[[1], [2}]");
+    TEST_SKIP(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, 0, "{\"a\":[1]");
+    /* 只检查括号和字符串 */
+    TEST_SKIP(JSON_PARSE_OK, 9, "[1 2, x:]");
+
+    /* 只保留需要的键，其余的成员直接跳过 */
+    static const char* const keys[] = { "id", "user", "name", NULL };
+    const char* json = "{ \"id\" : 7, \"payload\" : [ { \"name\" : \"x\" }, \"}\" ], \"user\" : { \"name\" : \"a\", \"age\" : 3 }, \"tags\" : {} }";
+    json_value v, e;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_keys(&v, json, strlen(json), keys));
+    json_init(&e);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, "{\"id\":7,\"user\":{\"name\":\"a\"}}"));
+    EXPECT_EQ_TRUE(json_is_equal(&e, &v));
+    json_free(&e);
+    json_free(&v);
+    /* 被跳过的部分也要括号配对 */
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_keys(&v, "{\"x\":[1}", 8, keys));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_parse_keys(&v, "{\"x\":1 \"id\":2}", 14, keys));
+}
+
+#define TEST_ERROR_EX(error, expect_offset, expect_line, expect_column, expect_path, json)\
+    do {\
+        json_value v;\
+        json_parse_error err;\
+        v.type = JSON_FALSE;\
+        EXPECT_EQ_INT(error, json_parse_ex(&v, json, strlen(json), &err));\
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));\
+        EXPECT_EQ_SIZE_T(expect_offset, err.offset);\
+        EXPECT_EQ_SIZE_T(expect_line, err.line);\
+        EXPECT_EQ_SIZE_T(expect_column, err.column);\
+        EXPECT_EQ_STRING(expect_path, err.path, strlen(err.path));\
+    } while(0)
+
+static void test_parse_ex() {
+    json_value v;
+    json_parse_error err;
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, "[1]", 3, &err));
+    json_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_VALUE, json_parse_ex(&v, "?", 1, NULL));
+
+    TEST_ERROR_EX(JSON_PARSE_EXPECT_VALUE, 1, 1, 2, "$", " ");
+    TEST_ERROR_EX(JSON_PARSE_ROOT_NOT_SINGULAR, 6, 1, 7, "$", "[1,2] x");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_VALUE, 23, 1, 24, "$.items[1].name", "{\"items\":[1,{\"name\":tru}]}");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_VALUE, 38, 4, 17, "$.items[1].name", "{\n  \"items\": [\n    1,\n    {\"name\": tru}\n  ]\n}");
+    TEST_ERROR_EX(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, 7, 1, 8, "$.a", "{\"a\":1 \"b\":2}");
+    TEST_ERROR_EX(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 9, 1, 10, "$[1][1]", "[[], [1,2}]");
+    TEST_ERROR_EX(JSON_PARSE_MISS_KEY, 8, 1, 9, "$", "{\"x\":{},1}");
+    TEST_ERROR_EX(JSON_PARSE_MISS_COLON, 10, 1, 11, "$.x.y", "{\"x\":{\"y\" 1}}");
+    TEST_ERROR_EX(JSON_PARSE_NUMBER_TOO_BIG, 6, 1, 7, "$.n", "{\"n\": 1e309}");
+    /* 字面量指向第一个不匹配的字符，字符串中的错误指向出错的字符或转义序列开头的反斜杠 */
+    TEST_ERROR_EX(JSON_PARSE_MISS_QUOTATION_MARK, 8, 1, 9, "$[0]", "[\"abc\\\"]");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_STRING_CHAR, 12, 1, 13, "$[\"a b\"][1]", "{\"a b\":[0,\"x\x01\"]}");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_STRING_ESCAPE, 13, 1, 14, "$[\"\\\"\\u0041\"]", "{\"\\\"\\u0041\":\"\\x\"}");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_UNICODE_HEX, 3, 1, 4, "$", "\"ab\\u12\"");
+    TEST_ERROR_EX(JSON_PARSE_INVALID_UNICODE_SURROGATE, 1, 1, 2, "$", "\"\\uD800\\u0041\"");
+    /* 缺少逗号时路径指向前一个值，键中出错时路径到对象为止 */
+    TEST_ERROR_EX(JSON_PARSE_INVALID_STRING_ESCAPE, 8, 1, 9, "$.a", "{\"a\":{\"b\\q\":1}}");
+
+    /* 太长的路径被截断 */
+    char json[400];
+    memset(json, '[', 300);
+    json[300] = '\0';
+    EXPECT_EQ_INT(JSON_PARSE_EXPECT_VALUE, json_parse_ex(&v, json, 300, &err));
+    EXPECT_EQ_SIZE_T(300, err.offset);
+    EXPECT_EQ_SIZE_T(JSON_PARSE_ERROR_PATH_SIZE - 1, strlen(err.path));
+    EXPECT_EQ_TRUE(memcmp(err.path, "$[0][0]", 7) == 0);
+    EXPECT_EQ_TRUE(memcmp(err.path + JSON_PARSE_ERROR_PATH_SIZE - 4, "...", 3) == 0);
+}
+
+/* n层嵌套的数组[[[0]]]或对象{"a":{"a":0}} */
+static char* test_nested(size_t n, int object, size_t* len) {
+    char* json = (char*)malloc(n * 6 + 2);
+    char* p = json;
+    for (size_t i = 0; i < n; i ++) {
+        if (object) {
+            memcpy(p, "{\"a\":", 5);
+            p += 5;
+        } else {
+            *p ++ = '[';
+        }
+    }
+    *p ++ = '0';
+    memset(p, object ? '}' : ']', n);
+    p += n;
+    *p = '\0';
+    *len = p - json;
+    return json;
+}
+
+static void test_parse_depth() {
+    json_value v, v2;
+    json_parse_error err;
+    size_t old = json_get_max_depth(), len, skipped;
+    json_set_max_depth(3);
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, "[[[0]], {\"a\":[]}]"));
+    json_free(&v);
+    TEST_ERROR(JSON_PARSE_TOO_DEEP, "[[[[0]]]]");
+    TEST_ERROR(JSON_PARSE_TOO_DEEP, "{\"a\":{\"b\":[{}]}}");
+    TEST_ERROR(JSON_PARSE_TOO_DEEP, "[[[[");
+    TEST_ERROR_EX(JSON_PARSE_TOO_DEEP, 9, 1, 10, "$[1][1][1]", "[0,[1,[2,[3]]]]");
+    TEST_SAX(JSON_PARSE_TOO_DEEP, "[[[", "[[[[0]]]]", -1);
+
+    /* 跳过的内容也受限制 */
+    const char* keys[] = { "a", NULL };
+    TEST_SKIP(JSON_PARSE_OK, 6, "[[[]]]");
+    TEST_SKIP(JSON_PARSE_TOO_DEEP, 0, "[[[[]]]]");
+    const char* json = "{\"a\":1,\"b\":[[]]}";
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_keys(&v, json, strlen(json), keys));
+    json_free(&v);
+    json = "{\"a\":1,\"b\":[[[]]]}";
+    EXPECT_EQ_INT(JSON_PARSE_TOO_DEEP, json_parse_keys(&v, json, strlen(json), keys));
+    EXPECT_EQ_INT(JSON_PARSE_TOO_DEEP, json_parse_lazy(&v, "[[[[0]]]]", 9));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_skip_value("[[[0]]]", 7, &skipped));
+
+    json_stream* s = json_stream_new(&v);
+    EXPECT_EQ_INT(JSON_PARSE_TOO_DEEP, json_stream_feed(s, "[[[[", 4));
+    json_stream_free(s);
+    EXPECT_EQ_INT(JSON_PARSE_TOO_DEEP, json_from_cbor(&v, "\x81\x81\xa1\x61\x61\x80", 6));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_from_cbor(&v, "\x81\x81\xa1\x61\x61\x00", 6));
+    json_free(&v);
+
+    /* 不限制时嵌套层数只受内存限制：解析、生成、拷贝、比较和释放都不使用递归 */
+    json_set_max_depth(0);
+    for (int object = 0; object <= 1; object ++) {
+        char* deep = test_nested(200000, object, &len);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, deep, len));
+        size_t length;
+        char* json2 = json_stringify(&v, &length);
+        EXPECT_EQ_SIZE_T(len, length);
+        EXPECT_EQ_TRUE(memcmp(deep, json2, len) == 0);
+        json_init(&v2);
+        json_copy(&v2, &v);
+        EXPECT_EQ_TRUE(json_is_equal(&v, &v2));
+        json_free(&v2);
+        /* CBOR和平坦格式的读写也不使用递归 */
+        char* data = json_to_cbor(&v, &length);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_from_cbor(&v2, data, length));
+        EXPECT_EQ_TRUE(json_is_equal(&v, &v2));
+        json_free(&v2);
+        json_free_buffer(data);
+        json_flat root;
+        data = json_flat_build(&v, &length);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+        json_init(&v2);
+        json_flat_copy(&v2, root);
+        EXPECT_EQ_TRUE(json_is_equal(&v, &v2));
+        json_free(&v2);
+        json_free_buffer(data);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_skip_value(deep, len, &skipped));
+        EXPECT_EQ_SIZE_T(len, skipped);
+        /* 错误发生在最深处时逐层释放已经解析的部分 */
+        size_t at = object ? 200000 * 5 : 200000;
+        deep[at] = 'x';
+        EXPECT_EQ_INT(JSON_PARSE_INVALID_VALUE, json_parse_ex(&v2, deep, len, &err));
+        EXPECT_EQ_SIZE_T(at, err.offset);
+        json_free(&v);
+        free(deep);
+        json_free_buffer(json2);
+    }
+    json_set_max_depth(old);
+}
+
+static void test_parser() {
+    json_parser p;
+    json_parse_error err;
+    json_value v, e;
+    json_parser_init(&p);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(&p, &v, "[1,{\"a\":\"b\"}]", 13, NULL));
+    json_init(&e);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, "[1,{\"a\":\"b\"}]"));
+    EXPECT_EQ_TRUE(json_is_equal(&e, &v));
+    json_free(&e);
+    json_free(&v);
+    /* 解析栈留在解析器中，之后的解析不再分配 */
+    char* stack = p.stack;
+    size_t stack_size = p.stack_size;
+    EXPECT_EQ_TRUE(stack != NULL);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(&p, &v, "[2,{\"c\":\"d\"}]", 13, NULL));
+    EXPECT_EQ_TRUE(p.stack == stack);
+    EXPECT_EQ_SIZE_T(stack_size, p.stack_size);
+    json_free(&v);
+    /* 出错之后解析器仍然可用 */
+    v.type = JSON_FALSE;
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_parser_parse(&p, &v, "{\"a\" 1}", 7, &err));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_SIZE_T(5, err.offset);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(&p, &v, "{\"a\":1}", 7, &err));
+    EXPECT_EQ_INT(JSON_OBJECT, json_get_type(&v));
+    json_free(&v);
+    json_parser_free(&p);
+    EXPECT_EQ_TRUE(p.stack == NULL);
+}
+
+/* 两种解析引擎对同一输入的结果、错误码和出错位置必须相同 */
+static void test_engine_same(const char* json, size_t len) {
+    json_value v1, v2;
+    json_parse_error e1, e2;
+    json_engine old = json_get_engine();
+    json_set_engine(JSON_ENGINE_RECURSIVE);
+    int ret1 = json_parse_ex(&v1, json, len, &e1);
+    json_set_engine(JSON_ENGINE_INDEXED);
+    int ret2 = json_parse_ex(&v2, json, len, &e2);
+    json_set_engine(old);
+    EXPECT_EQ_INT(ret1, ret2);
+    if (ret1 == JSON_PARSE_OK && ret2 == JSON_PARSE_OK) {
+        EXPECT_EQ_TRUE(json_is_equal(&v1, &v2));
+    } else if (ret1 == ret2) {
+        EXPECT_EQ_SIZE_T(e1.offset, e2.offset);
+        EXPECT_EQ_TRUE(strcmp(e1.path, e2.path) == 0);
+    }
+    json_free(&v1);
+    json_free(&v2);
+}
+
+static void test_parse_engine() {
+    /* 空白、转义、字符串和标量跨越64字节块的各种位置 */
+    static const char* tails[] = {
+        "1 ]", "\"a\\\\\" , 2]", "\"\\\"  x \" ,\t{ \"k\" : [ ] } ]", "\"\\\\\"  x \" ]", "nul l]", "1 2]", "\"a\" \"b\"]",
+        "tru\te]", "-12.5e3,true,false,null]", "{\"a\\u00e9\":\"\\ud83d\\ude00\"}]", "01]", "1.]", "\"\x01\"]", "\"\\x\"]", "{\"a\" 1}]",
+        "{\"a\":1,}]", "[1,]]", "\"abc]", "1\\]", "\"a\"x]", "{\"a\":1]", "[}", "1e400]", "12345678901234567890123]"
+    };
+    char buf[512];
+    for (size_t t = 0; t < sizeof(tails) / sizeof(tails[0]); t ++) {
+        for (size_t pad = 0; pad < 140; pad ++) {
+            size_t len = 0;
+            buf[len ++] = '[';
+            for (size_t i = 0; i < pad; i ++) {
+                buf[len ++] = i % 3 == 0 ? '\n' : ' ';
+            }
+            len += sprintf(buf + len, "\"%.*s\", %s", (int)(pad % 70), "\\\\\\\"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", tails[t]);
+            test_engine_same(buf, len);
+            test_engine_same(buf, len - 1); /* 缺少最后的']' */
+            test_engine_same(buf + pad + 1, len - pad - 1); /* 根不是数组 */
+        }
+    }
+
+    /* 超过一个索引窗口的大文档 */
+    size_t n = 20000, len = 0;
+    char* json = (char*)malloc(n * 64);
+    len += sprintf(json + len, "{\n  \"items\" : [\n");
+    for (size_t i = 0; i < n; i ++) {
+        len += sprintf(json + len, "    { \"id\" : %d, \"s\" : \"\\\"%d\\\\\" }%s\n", (int)i, (int)i, i + 1 < n ? "," : "");
+    }
+    len += sprintf(json + len, "  ]\n}\n");
+    test_engine_same(json, len);
+    json[len / 2] = '\x01'; /* 中间的一个字节改成控制字符 */
+    test_engine_same(json, len);
+    json[len - 4] = ' '; /* 把数组的']'改成空白 */
+    test_engine_same(json, len);
+    free(json);
+
+    /* 一个字符串跨越多个窗口 */
+    len = 0;
+    json = (char*)malloc(300000);
+    json[len ++] = '[';
+    json[len ++] = '\"';
+    for (size_t i = 0; i < 200000; i ++) {
+        json[len ++] = i % 1000 == 999 ? '\\' : 'a';
+        if (i % 1000 == 999) {
+            json[len ++] = 'n';
+        }
+    }
+    len += sprintf(json + len, "\",1]");
+    test_engine_same(json, len);
+    free(json);
+}
+
 static void test_parse() {
     test_parse_null();
     test_parse_true();
     test_parse_false();
     test_parse_number();
+    test_parse_integer();
     test_parse_string();
+    test_parse_long_string();
     test_parse_array();
     test_parse_object();
     test_parse_expect_value();
@@ -346,6 +1256,19 @@ static void test_parse() {
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_parse_n();
+    test_parse_arena();
+    test_parse_insitu();
+    test_parse_intern();
+    test_parse_sax();
+    test_parse_stream();
+    test_parse_ndjson();
+    test_parse_lazy();
+    test_parse_skip();
+    test_parse_ex();
+    test_parse_depth();
+    test_parser();
+    test_parse_engine();
 }
 
 
@@ -360,7 +1283,7 @@ static void test_parse() {
         json2 = json_stringify(&v, &length);\
         EXPECT_EQ_STRING(json, json2, length);\
         json_free(&v);\
-        free(json2);\
+        json_free_buffer(json2);\
     } while(0)
 
 static void test_stringify_number() {
@@ -376,14 +1299,28 @@ static void test_stringify_number() {
     TEST_ROUNDTRIP("1.234e-20");
 
     TEST_ROUNDTRIP("1.0000000000000002"); /* the smallest number > 1 */
-    TEST_ROUNDTRIP("4.9406564584124654e-324"); /* minimum denormal */
-    TEST_ROUNDTRIP("-4.9406564584124654e-324");
-    TEST_ROUNDTRIP("2.2250738585072009e-308");  /* Max subnormal double */
-    TEST_ROUNDTRIP("-2.2250738585072009e-308");
+    TEST_ROUNDTRIP("5e-324"); /* minimum denormal */
+    TEST_ROUNDTRIP("-5e-324");
+    TEST_ROUNDTRIP("2.225073858507201e-308");  /* Max subnormal double */
+    TEST_ROUNDTRIP("-2.225073858507201e-308");
     TEST_ROUNDTRIP("2.2250738585072014e-308");  /* Min normal positive double */
     TEST_ROUNDTRIP("-2.2250738585072014e-308");
     TEST_ROUNDTRIP("1.7976931348623157e+308");  /* Max double */
     TEST_ROUNDTRIP("-1.7976931348623157e+308");
+    // 输出能还原为同一个double的最短数字
+    TEST_ROUNDTRIP("0.1");
+    TEST_ROUNDTRIP("0.3");
+    TEST_ROUNDTRIP("0.0001");
+    TEST_ROUNDTRIP("1e-5");
+    TEST_ROUNDTRIP("123.456");
+    TEST_ROUNDTRIP("9007199254740992");
+    TEST_ROUNDTRIP("18014398509481984");
+    TEST_ROUNDTRIP("1e+17");
+    TEST_ROUNDTRIP("1.2345678901234568e+20");
+    // 整数原样输出，不经过double
+    TEST_ROUNDTRIP("9007199254740993");
+    TEST_ROUNDTRIP("-9223372036854775808");
+    TEST_ROUNDTRIP("18446744073709551615");
 }
 static void test_stringify_string() {
     TEST_ROUNDTRIP("\"\"");
@@ -391,6 +1328,9 @@ static void test_stringify_string() {
     TEST_ROUNDTRIP("\"Hello\\nWorld\"");
     TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
+    TEST_ROUNDTRIP("\"The quick brown fox jumps over the lazy dog, then the \\\"dog\\\" naps\"");
+    TEST_ROUNDTRIP("\"0123456789abcdef0123456789abcdef\\u001F0123456789abcdef0123456789abcdef\\\\\"");
+    TEST_ROUNDTRIP("\"\\t0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\\r\\n\"");
     // utf-8 暂时还不能序列化这样的字符串
     //TEST_ROUNDTRIP("\"\\ud834\\udd1e\"");
 }
@@ -402,6 +1342,159 @@ static void test_stringify_object() {
     TEST_ROUNDTRIP("{}");
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
+typedef struct {
+    char* buf;
+    size_t len, calls, max_chunk, stop_at;
+} test_writer;
+
+static int test_write(void* ud, const char* data, size_t len) {
+    test_writer* w = (test_writer*)ud;
+    w->buf = (char*)realloc(w->buf, w->len + len);
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    if (len > w->max_chunk) {
+        w->max_chunk = len;
+    }
+    return ++ w->calls != w->stop_at;
+}
+
+static void test_stringify_to() {
+    json_value v;
+    size_t length;
+    test_writer w = { NULL, 0, 0, 0, 0 };
+    /* 输出分多次交给writer，拼起来与json_stringify相同 */
+    json_init(&v);
+    json_set_array(&v, 0);
+    for (int i = 0; i < 5000; i ++) {
+        json_value* e = json_pushback_array_element(&v);
+        json_set_array(e, 0);
+        json_set_int64(json_pushback_array_element(e), i);
+        json_set_string(json_pushback_array_element(e), "a\"b\n", 4);
+    }
+    char* json = json_stringify(&v, &length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stringify_to(&v, test_write, &w));
+    EXPECT_EQ_TRUE(w.calls > 1);
+    EXPECT_EQ_TRUE(w.max_chunk <= 16384);
+    EXPECT_EQ_SIZE_T(length, w.len);
+    EXPECT_EQ_TRUE(memcmp(json, w.buf, length) == 0);
+    json_free_buffer(json);
+
+    /* writer返回0之后不再调用 */
+    free(w.buf);
+    w.buf = NULL;
+    w.len = w.calls = w.max_chunk = 0;
+    w.stop_at = 2;
+    EXPECT_EQ_INT(JSON_PARSE_STOPPED, json_stringify_to(&v, test_write, &w));
+    EXPECT_EQ_SIZE_T(2, w.calls);
+    json_free(&v);
+
+    /* 比缓冲区长的字符串直接交给writer */
+    char* s = (char*)malloc(100000);
+    memset(s, 'x', 100000);
+    s[50000] = '\t';
+    json_set_string(&v, s, 100000);
+    json = json_stringify(&v, &length);
+    free(w.buf);
+    w.buf = NULL;
+    w.len = w.calls = w.max_chunk = w.stop_at = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stringify_to(&v, test_write, &w));
+    EXPECT_EQ_SIZE_T(50000, w.max_chunk);
+    EXPECT_EQ_SIZE_T(length, w.len);
+    EXPECT_EQ_TRUE(memcmp(json, w.buf, length) == 0);
+    json_free_buffer(json);
+    free(w.buf);
+    free(s);
+    json_free(&v);
+}
+
+#define TEST_STRINGIFY_EX(expect, json, flags, indent)\
+    do {\
+        json_value v;\
+        size_t length, length2;\
+        json_init(&v);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));\
+        char* out = json_stringify_ex(&v, &length, flags, indent);\
+        EXPECT_EQ_STRING(expect, out, length);\
+        char* out2 = json_stringify_ex(&v, &length2, (flags) | JSON_STRINGIFY_PRESIZE, indent);\
+        EXPECT_EQ_STRING(expect, out2, length2);\
+        json_free_buffer(out);\
+        json_free_buffer(out2);\
+        json_free(&v);\
+    } while(0)
+
+static void test_stringify_ex() {
+    TEST_STRINGIFY_EX("[1,{\"b\":2,\"a\":[]}]", "[1,{\"b\":2,\"a\":[]}]", 0, 0);
+    /* 缩进 */
+    TEST_STRINGIFY_EX("[\n  1,\n  {\n    \"b\": 2,\n    \"a\": [],\n    \"c\": {}\n  }\n]", "[1,{\"b\":2,\"a\":[],\"c\":{}}]", 0, 2);
+    TEST_STRINGIFY_EX("{\n    \"a\": [\n        true\n    ]\n}", "{\"a\":[true]}", 0, 4);
+    TEST_STRINGIFY_EX("\"x\"", "\"x\"", 0, 2);
+    /* 按UTF-16编码单元排序(RFC 8785 3.2.3的例子)，控制字符用小写十六进制 */
+    TEST_STRINGIFY_EX("{\"\\r\":0,\"1\":1,\"\xC2\x80\":2,\"\xC3\xB6\":3,\"\xE2\x82\xAC\":4,\"\xF0\x9F\x98\x80\":5,\"\xEF\xAC\xB3\":6}",
+        "{\"\\u20ac\":4,\"\\r\":0,\"\\ufb33\":6,\"1\":1,\"\\ud83d\\ude00\":5,\"\\u0080\":2,\"\\u00f6\":3}", JSON_STRINGIFY_SORT_KEYS, 0);
+    TEST_STRINGIFY_EX("{\"a\":{\"x\":\"\\u001f\",\"y\":1},\"b\":[{\"c\":1,\"d\":2}],\"ba\":null}",
+        "{\"ba\":null,\"b\":[{\"d\":2,\"c\":1}],\"a\":{\"y\":1,\"x\":\"\\u001F\"}}", JSON_STRINGIFY_SORT_KEYS, 0);
+    /* 重复的键保持原来的顺序 */
+    TEST_STRINGIFY_EX("{\"a\":2,\"a\":1,\"b\":0}", "{\"b\":0,\"a\":2,\"a\":1}", JSON_STRINGIFY_SORT_KEYS, 0);
+    /* 只输出ASCII */
+    TEST_STRINGIFY_EX("\"a\\u00A2\\u20AC\\uD834\\uDD1E\\u00E9z\"", "\"a\xC2\xA2\xE2\x82\xAC\xF0\x9D\x84\x9E\xC3\xA9z\"", JSON_STRINGIFY_ASCII, 0);
+    TEST_STRINGIFY_EX("{\n  \"\\u00e9\": \"\\n\\ud834\\udd1e\"\n}", "{\"\xC3\xA9\":\"\\n\xF0\x9D\x84\x9E\"}", JSON_STRINGIFY_ASCII | JSON_STRINGIFY_SORT_KEYS, 2);
+    /* 各种格式的数字和转义，PRESIZE算出的长度要与实际输出完全一致 */
+    TEST_STRINGIFY_EX("[\n 0,\n -0,\n 1.5,\n -1e-7,\n 0.001234,\n 123400,\n 1.2345678901234568e+29,\n 1e+100,\n"
+        " -9223372036854775808,\n 18446744073709551615,\n \"\\u0001\\t\\\"\"\n]",
+        "[0,-0,1.5,-1e-7,0.001234,123400,1.2345678901234568e+29,1e+100,-9223372036854775808,18446744073709551615,\"\\u0001\\t\\\"\"]", 0, 1);
+
+    /* 不合法的UTF-8写成U+FFFD */
+    json_value v;
+    size_t length;
+    json_init(&v);
+    json_set_string(&v, "\xC0\xAF\xED\xA0\x80\xE2\x82", 7);
+    char* out = json_stringify_ex(&v, &length, JSON_STRINGIFY_ASCII, 0);
+    EXPECT_EQ_STRING("\"\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\"", out, length);
+    json_free_buffer(out);
+    out = json_stringify_ex(&v, &length, JSON_STRINGIFY_ASCII | JSON_STRINGIFY_PRESIZE, 0);
+    EXPECT_EQ_STRING("\"\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\\uFFFD\"", out, length);
+    json_free_buffer(out);
+    json_free(&v);
+}
+
+static void test_stringify_writer() {
+    json_writer w;
+    json_value v;
+    size_t length;
+    const char* compact = "{\"c\":\"x\",\"a\":[1,2,{\"b\":null}]}";
+    json_writer_init(&w);
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, compact));
+    const char* json = json_writer_stringify(&w, &v, &length, 0, 0);
+    EXPECT_EQ_STRING("{\"c\":\"x\",\"a\":[1,2,{\"b\":null}]}", json, length);
+    EXPECT_EQ_TRUE(json == w.buffer);
+    /* 结果留在生成器的缓冲区中，下一次生成时被覆盖 */
+    EXPECT_EQ_TRUE(json_writer_stringify(&w, &v, &length, JSON_STRINGIFY_SORT_KEYS, 1) == json);
+    EXPECT_EQ_STRING("{\n \"a\": [\n  1,\n  2,\n  {\n   \"b\": null\n  }\n ],\n \"c\": \"x\"\n}", json, length);
+    EXPECT_EQ_TRUE(json_writer_stringify(&w, &v, &length, JSON_STRINGIFY_PRESIZE, 0) == json);
+    EXPECT_EQ_STRING("{\"c\":\"x\",\"a\":[1,2,{\"b\":null}]}", json, length);
+    json_free(&v);
+
+    /* 缓冲区比JSON_WRITER_BUFFER_SIZE大时，每次交给writer的字节数也不超过它 */
+    test_writer t = { NULL, 0, 0, 0, 0 };
+    json_set_array(&v, 0);
+    for (int i = 0; i < 5000; i ++) {
+        json_set_string(json_pushback_array_element(&v), "0123456789", 10);
+    }
+    char* expect = json_stringify(&v, &length);
+    json_writer_stringify(&w, &v, NULL, 0, 0);
+    EXPECT_EQ_TRUE(w.size > 16384);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_writer_stringify_to(&w, &v, test_write, &t));
+    EXPECT_EQ_TRUE(t.max_chunk <= 16384);
+    EXPECT_EQ_SIZE_T(length, t.len);
+    EXPECT_EQ_TRUE(memcmp(expect, t.buf, length) == 0);
+    json_free_buffer(expect);
+    free(t.buf);
+    json_free(&v);
+    json_writer_free(&w);
+    EXPECT_EQ_TRUE(w.buffer == NULL);
+}
+
 static void test_stringify() {
     TEST_ROUNDTRIP("null");
     TEST_ROUNDTRIP("false");
@@ -410,6 +1503,9 @@ static void test_stringify() {
     test_stringify_string();
     test_stringify_array();
     test_stringify_object();
+    test_stringify_to();
+    test_stringify_ex();
+    test_stringify_writer();
 }
 
 
@@ -434,6 +1530,11 @@ static void test_equal() {
     TEST_EQUAL("null", "0", 0);
     TEST_EQUAL("123", "123", 1);
     TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("1", "1.0", 1);
+    TEST_EQUAL("-0", "0", 1);
+    TEST_EQUAL("1", "1.5", 0);
+    TEST_EQUAL("9007199254740993", "9007199254740992", 0);
+    TEST_EQUAL("18446744073709551615", "-1", 0);
     TEST_EQUAL("\"abc\"", "\"abc\"", 1);
     TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
     TEST_EQUAL("[]", "[]", 1);
@@ -463,6 +1564,254 @@ static void test_copy() {
     json_free(&v2);
 }
 
+/* 编码结果与RFC 8949附录A相同(浮点数能用float表示时写成4字节) */
+#define TEST_CBOR(bytes, json)\
+    do {\
+        json_value v, e;\
+        size_t length;\
+        json_init(&e);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, json));\
+        char* cbor = json_to_cbor(&e, &length);\
+        EXPECT_EQ_SIZE_T(sizeof(bytes) - 1, length);\
+        EXPECT_EQ_TRUE(memcmp(bytes, cbor, length) == 0);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_from_cbor(&v, bytes, sizeof(bytes) - 1));\
+        EXPECT_EQ_TRUE(json_is_equal(&e, &v));\
+        EXPECT_EQ_INT(json_is_integer(&e), json_is_integer(&v));\
+        json_free_buffer(cbor);\
+        json_free(&v);\
+        json_free(&e);\
+    } while(0)
+
+#define TEST_CBOR_NUMBER(expect, bytes)\
+    do {\
+        json_value v;\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_from_cbor(&v, bytes, sizeof(bytes) - 1));\
+        EXPECT_EQ_DOUBLE(expect, json_get_number(&v));\
+    } while(0)
+
+#define TEST_CBOR_ERROR(error, bytes)\
+    do {\
+        json_value v;\
+        v.type = JSON_FALSE;\
+        EXPECT_EQ_INT(error, json_from_cbor(&v, bytes, sizeof(bytes) - 1));\
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));\
+    } while(0)
+
+static void test_cbor() {
+    TEST_CBOR("\x00", "0");
+    TEST_CBOR("\x17", "23");
+    TEST_CBOR("\x18\x18", "24");
+    TEST_CBOR("\x18\x64", "100");
+    TEST_CBOR("\x19\x03\xe8", "1000");
+    TEST_CBOR("\x1a\x00\x0f\x42\x40", "1000000");
+    TEST_CBOR("\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00", "1000000000000");
+    TEST_CBOR("\x1b\xff\xff\xff\xff\xff\xff\xff\xff", "18446744073709551615");
+    TEST_CBOR("\x3b\x7f\xff\xff\xff\xff\xff\xff\xff", "-9223372036854775808");
+    TEST_CBOR("\x20", "-1");
+    TEST_CBOR("\x29", "-10");
+    TEST_CBOR("\x38\x63", "-100");
+    TEST_CBOR("\x39\x03\xe7", "-1000");
+    TEST_CBOR("\xfa\x3f\xc0\x00\x00", "1.5");
+    TEST_CBOR("\xfa\x80\x00\x00\x00", "-0.0");
+    TEST_CBOR("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1");
+    TEST_CBOR("\xfb\x7e\x37\xe4\x3c\x88\x00\x75\x9c", "1.0e+300");
+    TEST_CBOR("\xf4", "false");
+    TEST_CBOR("\xf5", "true");
+    TEST_CBOR("\xf6", "null");
+    TEST_CBOR("\x60", "\"\"");
+    TEST_CBOR("\x61\x61", "\"a\"");
+    TEST_CBOR("\x64\x49\x45\x54\x46", "\"IETF\"");
+    TEST_CBOR("\x62\x00\x7a", "\"\\u0000z\"");
+    TEST_CBOR("\x80", "[]");
+    TEST_CBOR("\x83\x01\x02\x03", "[1,2,3]");
+    TEST_CBOR("\x83\x01\x82\x02\x03\x82\x04\x05", "[1,[2,3],[4,5]]");
+    TEST_CBOR("\xa0", "{}");
+    TEST_CBOR("\xa2\x61\x61\x01\x61\x62\x82\x02\x03", "{\"a\":1,\"b\":[2,3]}");
+
+    /* 写入时不会产生的编码 */
+    TEST_CBOR_NUMBER(1.0, "\xf9\x3c\x00");
+    TEST_CBOR_NUMBER(65504.0, "\xf9\x7b\xff");
+    TEST_CBOR_NUMBER(5.960464477539063e-8, "\xf9\x00\x01");
+    TEST_CBOR_NUMBER(-4.0, "\xf9\xc4\x00");
+    TEST_CBOR_NUMBER(-1.0 / 0.0, "\xf9\xfc\x00");
+    TEST_CBOR_NUMBER(-18446744073709551616.0, "\x3b\xff\xff\xff\xff\xff\xff\xff\xff");
+    TEST_CBOR_NUMBER(1.0, "\x18\x01");
+
+    TEST_CBOR_ERROR(JSON_PARSE_EXPECT_VALUE, "");
+    TEST_CBOR_ERROR(JSON_PARSE_ROOT_NOT_SINGULAR, "\x00\x00");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x18");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x62\x61");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x41\x61"); /* 字节串 */
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\xc1\x00"); /* 标签 */
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x9f\x01\xff"); /* 不定长度 */
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\xf7"); /* undefined */
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x83\x01\x61\x61");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x82\x01\x82\x61\x61\x61");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\xa1\x01\x01"); /* 键不是字符串 */
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\xa2\x61\x61\x01\x61\x62");
+    TEST_CBOR_ERROR(JSON_PARSE_INVALID_CBOR, "\x9b\xff\xff\xff\xff\xff\xff\xff\xff\x00");
+
+    /* float范围的边界：FLT_MAX能用4字节表示，稍大一点的数和nan用8字节，inf用4字节 */
+    {
+        static const double numbers[] = { 3.4028234663852886e+38, 3.4028234663852889e+38, -1e300 };
+        static const size_t sizes[] = { 5, 9, 9, 5, 9 };
+        json_value n;
+        size_t length;
+        for (int i = 0; i < 5; i ++) {
+            json_init(&n);
+            json_set_number(&n, i < 3 ? numbers[i] : i == 3 ? 1.0 / 0.0 : 0.0 / 0.0);
+            char* data = json_to_cbor(&n, &length);
+            EXPECT_EQ_SIZE_T(sizes[i], length);
+            json_free_buffer(data);
+        }
+    }
+
+    /* 大对象的哈希索引在读取后仍然可用 */
+    json_value v, e;
+    json_init(&e);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8,\"i\":9,"
+        "\"j\":10,\"k\":11,\"l\":12,\"m\":13,\"n\":14,\"o\":15,\"p\":{\"q\":[\"r\",null,true,0.5]}}"));
+    size_t length;
+    char* cbor = json_to_cbor(&e, &length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_from_cbor(&v, cbor, length));
+    EXPECT_EQ_TRUE(json_is_equal(&e, &v));
+    EXPECT_EQ_DOUBLE(15.0, json_get_number(json_find_object_value(&v, "o", 1)));
+    json_free_buffer(cbor);
+    json_free(&v);
+    json_free(&e);
+}
+
+/* 把data中off处的8个字节改成value，json_flat_open应该报错，只检查头部的json_flat_open_unchecked仍然成功，最后恢复原值 */
+#define TEST_FLAT_CORRUPT(data, length, off, value)\
+    do {\
+        uint64_t old, bad = (value);\
+        json_flat r;\
+        memcpy(&old, (data) + (off), sizeof(old));\
+        memcpy((data) + (off), &bad, sizeof(bad));\
+        EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open(&r, data, length));\
+        EXPECT_EQ_TRUE(r.slot == NULL);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open_unchecked(&r, data, length));\
+        memcpy((data) + (off), &old, sizeof(old));\
+    } while (0)
+
+static void test_flat() {
+    const char* json = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-42,\"u\":18446744073709551615,\"d\":1.5,"
+        "\"s\":\"Hello\\u0000World\",\"e\":\"\",\"a\":[1,[2,\"x\"],{}],\"o\":{\"b\":1,\"a\":2,\"\":3}}";
+    json_value v, c;
+    json_flat root, f;
+    size_t length;
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+    char* data = json_flat_build(&v, &length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+    EXPECT_EQ_INT(JSON_OBJECT, json_flat_get_type(root));
+    EXPECT_EQ_SIZE_T(10, json_flat_get_object_size(root));
+    /* 成员保持原来的顺序 */
+    EXPECT_EQ_STRING("t", json_flat_get_object_key(root, 2), json_flat_get_object_key_length(root, 2));
+    EXPECT_EQ_INT(JSON_NULL, json_flat_get_type(json_flat_find_object_value(root, "n", 1)));
+    EXPECT_EQ_FALSE(json_flat_get_boolean(json_flat_find_object_value(root, "f", 1)));
+    EXPECT_EQ_TRUE(json_flat_get_boolean(json_flat_find_object_value(root, "t", 1)));
+    f = json_flat_find_object_value(root, "i", 1);
+    EXPECT_EQ_TRUE(json_flat_is_integer(f));
+    EXPECT_EQ_INT64(-42, json_flat_get_int64(f));
+    EXPECT_EQ_DOUBLE(-42.0, json_flat_get_number(f));
+    EXPECT_EQ_UINT64(18446744073709551615ULL, json_flat_get_uint64(json_flat_find_object_value(root, "u", 1)));
+    f = json_flat_find_object_value(root, "d", 1);
+    EXPECT_EQ_FALSE(json_flat_is_integer(f));
+    EXPECT_EQ_DOUBLE(1.5, json_flat_get_number(f));
+    f = json_flat_find_object_value(root, "s", 1);
+    EXPECT_EQ_STRING("Hello\0World", json_flat_get_string(f), json_flat_get_string_length(f));
+    EXPECT_EQ_TRUE(json_flat_get_string(f)[json_flat_get_string_length(f)] == '\0');
+    f = json_flat_find_object_value(root, "e", 1);
+    EXPECT_EQ_SIZE_T(0, json_flat_get_string_length(f));
+    f = json_flat_find_object_value(root, "a", 1);
+    EXPECT_EQ_SIZE_T(3, json_flat_get_array_size(f));
+    EXPECT_EQ_SIZE_T(2, json_flat_get_array_size(json_flat_get_array_element(f, 1)));
+    f = json_flat_get_array_element(json_flat_get_array_element(f, 1), 1);
+    EXPECT_EQ_STRING("x", json_flat_get_string(f), json_flat_get_string_length(f));
+    f = json_flat_find_object_value(root, "o", 1);
+    EXPECT_EQ_SIZE_T(0, json_flat_find_object_index(f, "b", 1));
+    EXPECT_EQ_SIZE_T(1, json_flat_find_object_index(f, "a", 1));
+    EXPECT_EQ_SIZE_T(2, json_flat_find_object_index(f, "", 0));
+    EXPECT_EQ_SIZE_T(JSON_KEY_NOT_EXIST, json_flat_find_object_index(f, "c", 1));
+    EXPECT_EQ_SIZE_T(JSON_KEY_NOT_EXIST, json_flat_find_object_index(f, "bb", 2));
+    EXPECT_EQ_TRUE(json_flat_find_object_value(root, "x", 1).slot == NULL);
+    /* 拷贝回json_value */
+    json_init(&c);
+    json_flat_copy(&c, root);
+    EXPECT_EQ_TRUE(json_is_equal(&v, &c));
+    json_free(&c);
+
+    /* 重复的键找到第一个 */
+    json_free(&v);
+    json_free_buffer(data);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, "{\"b\":1,\"a\":2,\"b\":3,\"b\":4}"));
+    data = json_flat_build(&v, &length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+    EXPECT_EQ_SIZE_T(0, json_flat_find_object_index(root, "b", 1));
+    EXPECT_EQ_SIZE_T(4, json_flat_get_object_size(root));
+
+    /* 头部检查 */
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open(&root, data, length - 8));
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open(&root, data, 8));
+    data[0] = 'X';
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open(&root, data, length));
+    EXPECT_EQ_TRUE(root.slot == NULL);
+    json_free_buffer(data);
+    json_free(&v);
+
+    /* 内容检查：头部40字节，根数组的块在40，内层数组在80，"ab"在120，对象在136，键"k"在176，"v"在192 */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, "[[1,\"ab\"],{\"k\":\"v\"}]"));
+    data = json_flat_build(&v, &length);
+    EXPECT_EQ_SIZE_T(208, length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+    TEST_FLAT_CORRUPT(data, length, 32, 0);                      /* 根的偏移指向头部 */
+    TEST_FLAT_CORRUPT(data, length, 32, 208);                    /* 根的偏移越界 */
+    TEST_FLAT_CORRUPT(data, length, 32, 44);                     /* 没有对齐 */
+    TEST_FLAT_CORRUPT(data, length, 40, 0x1000000000000000ULL);  /* 元素个数太大 */
+    TEST_FLAT_CORRUPT(data, length, 120, 100);                   /* 字符串长度越界 */
+    TEST_FLAT_CORRUPT(data, length, 120, 1);                     /* 字符串不以'\0'结尾 */
+    TEST_FLAT_CORRUPT(data, length, 168, 5);                     /* 排序后的下标越界 */
+    TEST_FLAT_CORRUPT(data, length, 144, 4096);                  /* 键的偏移越界 */
+    TEST_FLAT_CORRUPT(data, length, 56, 40);                     /* 内层数组指回外层数组 */
+    TEST_FLAT_CORRUPT(data, length, 88, JSON_OBJECT + 1);        /* 类型不正确 */
+    {
+        /* 截断后改写头部的长度 */
+        uint64_t copy[25];
+        memcpy(copy, data, sizeof(copy));
+        copy[2] = sizeof(copy);
+        EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open(&root, copy, sizeof(copy)));
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open_unchecked(&root, copy, sizeof(copy)));
+        copy[2] = 8;
+        EXPECT_EQ_INT(JSON_PARSE_INVALID_FLAT, json_flat_open_unchecked(&root, copy, sizeof(copy)));
+    }
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+    json_free_buffer(data);
+    json_free(&v);
+
+    /* 大对象用二分查找，每个键都能找到 */
+    json_set_object(&v, 0);
+    for (int i = 0; i < 1000; i ++) {
+        char key[16];
+        int n = sprintf(key, "k%d", (i * 7919) % 1000);
+        json_set_int64(json_set_object_value(&v, key, n), i);
+    }
+    data = json_flat_build(&v, &length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_flat_open(&root, data, length));
+    for (int i = 0; i < 1000; i ++) {
+        char key[16];
+        int n = sprintf(key, "k%d", (i * 7919) % 1000);
+        EXPECT_EQ_INT64(i, json_flat_get_int64(json_flat_find_object_value(root, key, n)));
+    }
+    json_init(&c);
+    json_flat_copy(&c, root);
+    EXPECT_EQ_TRUE(json_is_equal(&v, &c));
+    EXPECT_EQ_INT64(215, json_get_int64(json_find_object_value(&c, "k585", 4)));
+    json_free(&c);
+    json_free_buffer(data);
+    json_free(&v);
+}
+
 static void test_move() {
     json_value v1, v2, v3;
     json_init(&v1);
@@ -491,6 +1840,146 @@ static void test_swap() {
     json_free(&v2);
 }
 
+/* 计数分配器：每块前面16字节记录标记和大小，检查释放的都是经过分配器分配的内存 */
+typedef struct {
+    size_t allocs, frees, bytes; /* bytes是还没有释放的字节数 */
+    size_t bad; /* 交给realloc/free的指针不是这个分配器分配的 */
+} test_alloc_stats;
+#define TEST_ALLOC_MAGIC 0x6a736f6e616c6331ULL
+#if defined(__unix__) || defined(__APPLE__)
+static pthread_mutex_t test_alloc_lock = PTHREAD_MUTEX_INITIALIZER; /* NDJSON的工作线程会同时分配 */
+#define TEST_ALLOC_LOCK() pthread_mutex_lock(&test_alloc_lock)
+#define TEST_ALLOC_UNLOCK() pthread_mutex_unlock(&test_alloc_lock)
+#else
+#define TEST_ALLOC_LOCK()
+#define TEST_ALLOC_UNLOCK()
+#endif
+
+static void* test_alloc_malloc(void* ud, size_t size) {
+    test_alloc_stats* st = (test_alloc_stats*)ud;
+    unsigned long long* h = (unsigned long long*)malloc(16 + size);
+    h[0] = TEST_ALLOC_MAGIC;
+    h[1] = size;
+    TEST_ALLOC_LOCK();
+    st->allocs ++;
+    st->bytes += size;
+    TEST_ALLOC_UNLOCK();
+    return h + 2;
+}
+static void* test_alloc_realloc(void* ud, void* ptr, size_t size) {
+    test_alloc_stats* st = (test_alloc_stats*)ud;
+    unsigned long long* h = (unsigned long long*)ptr - 2;
+    TEST_ALLOC_LOCK();
+    if (ptr == NULL || h[0] != TEST_ALLOC_MAGIC) {
+        st->bad ++;
+        TEST_ALLOC_UNLOCK();
+        return NULL;
+    }
+    st->bytes += size - (size_t)h[1];
+    TEST_ALLOC_UNLOCK();
+    h = (unsigned long long*)realloc(h, 16 + size);
+    h[1] = size;
+    return h + 2;
+}
+static void test_alloc_free(void* ud, void* ptr) {
+    test_alloc_stats* st = (test_alloc_stats*)ud;
+    unsigned long long* h = (unsigned long long*)ptr - 2;
+    TEST_ALLOC_LOCK();
+    if (ptr == NULL || h[0] != TEST_ALLOC_MAGIC) {
+        st->bad ++;
+        TEST_ALLOC_UNLOCK();
+        return;
+    }
+    h[0] = 0;
+    st->frees ++;
+    st->bytes -= (size_t)h[1];
+    TEST_ALLOC_UNLOCK();
+    free(h);
+}
+static const json_allocator test_allocator_init = { test_alloc_malloc, test_alloc_realloc, test_alloc_free, NULL };
+static void* test_alloc_fail(void* ud, size_t size) {
+    (void)ud;
+    (void)size;
+    return NULL;
+}
+
+#define EXPECT_ALLOC_BALANCED(st)\
+    do {\
+        EXPECT_EQ_TRUE((st).allocs > 0);\
+        EXPECT_EQ_SIZE_T((st).allocs, (st).frees);\
+        EXPECT_EQ_SIZE_T(0, (st).bytes);\
+        EXPECT_EQ_SIZE_T(0, (st).bad);\
+    } while(0)
+
+static void test_allocator() {
+    json_allocator old = *json_get_allocator();
+    test_alloc_stats g = { 0, 0, 0, 0 }, ps = { 0, 0, 0, 0 }, ws = { 0, 0, 0, 0 }, as = { 0, 0, 0, 0 };
+    json_allocator a = test_allocator_init;
+    json_value v;
+    size_t length;
+    const char* json = "{\"a\":[1,2,{\"b\":\"x\\ny\"}],\"c\":\"hello\",\"d\":null}";
+
+    /* 全局分配器：值树、临时内存和返回的缓冲区都经过它 */
+    a.ud = &g;
+    json_set_allocator(&a);
+    EXPECT_EQ_TRUE(json_get_allocator()->ud == &g);
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+    char* out = json_stringify_ex(&v, &length, JSON_STRINGIFY_SORT_KEYS, 2);
+    json_free_buffer(out);
+    char* cbor = json_to_cbor(&v, &length);
+    json_free_buffer(cbor);
+    json_set_string(json_set_object_value(&v, "e", 1), "abc", 3);
+    json_free(&v);
+    EXPECT_ALLOC_BALANCED(g);
+
+    /* 解析器和生成器的缓冲区使用各自的分配器，值树仍然使用全局分配器 */
+    json_parser p;
+    json_parser_init(&p);
+    p.scratch_allocator.ud = &ps;
+    for (int i = 0; i < 3; i ++) {
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(&p, &v, json, strlen(json), NULL));
+        json_writer w;
+        json_writer_init(&w);
+        w.scratch_allocator.ud = &ws;
+        json_writer_stringify(&w, &v, &length, 0, 0);
+        json_writer_free(&w);
+        json_free(&v);
+    }
+    json_parser_free(&p);
+    EXPECT_ALLOC_BALANCED(ps);
+    EXPECT_ALLOC_BALANCED(ws);
+    EXPECT_ALLOC_BALANCED(g);
+
+    /* arena中解析完全不使用全局分配器 */
+    size_t before = g.allocs;
+    json_arena arena;
+    json_arena_init(&arena, 0);
+    arena.allocator.ud = &as;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_arena(&v, json, &arena));
+    EXPECT_EQ_SIZE_T(before, g.allocs);
+    json_arena_free(&arena);
+    EXPECT_ALLOC_BALANCED(as);
+    /* free之后保留分配器，可以继续使用 */
+    EXPECT_EQ_TRUE(arena.allocator.ud == &as);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_arena(&v, json, &arena));
+    json_arena_free(&arena);
+    EXPECT_ALLOC_BALANCED(as);
+
+    /* 分配失败时key pool返回NULL并保持不变 */
+    json_key_pool pool;
+    json_key_pool_init(&pool);
+    pool.keys.allocator.malloc = test_alloc_fail;
+    EXPECT_EQ_TRUE(json_key_pool_intern(&pool, "a", 1) == NULL);
+    EXPECT_EQ_SIZE_T(0, pool.size);
+    EXPECT_EQ_SIZE_T(0, pool.capacity);
+    json_key_pool_free(&pool);
+
+    json_set_allocator(NULL);
+    EXPECT_EQ_TRUE(json_get_allocator()->ud == NULL);
+    json_set_allocator(&old);
+}
+
 
 
 static void test_access_null() {
@@ -519,6 +2008,20 @@ static void test_access_number() {
     EXPECT_EQ_DOUBLE(123.456, json_get_number(&v));
     json_free(&v);
 }
+static void test_access_integer() {
+    json_value v;
+    json_init(&v);
+    json_set_string(&v, "a", 1);
+    json_set_int64(&v, -9007199254740993LL);
+    EXPECT_EQ_TRUE(json_is_integer(&v));
+    EXPECT_EQ_INT64(-9007199254740993LL, json_get_int64(&v));
+    json_set_uint64(&v, UINT64_MAX);
+    EXPECT_EQ_UINT64(UINT64_MAX, json_get_uint64(&v));
+    json_set_number(&v, 1.5);
+    EXPECT_EQ_FALSE(json_is_integer(&v));
+    EXPECT_EQ_INT64(1, json_get_int64(&v));
+    json_free(&v);
+}
 static void test_access_string() {
     json_value v;
     json_init(&v);
@@ -676,14 +2179,197 @@ static void test_access_object() {
     json_free(&o);
 }
 
+static void test_access_object_index() {
+    /* 大对象使用哈希索引查找，插入、删除、清空、收缩之后索引保持正确 */
+    json_value o, o2;
+    char key[16], json[16 * 40 + 8];
+    size_t i, n, len;
+
+    json_init(&o);
+    json_set_object(&o, 0);
+    for (i = 0; i < 1000; i ++) {
+        len = sprintf(key, "k%zu", i);
+        json_set_int64(json_set_object_value(&o, key, len), (int64_t)i);
+    }
+    EXPECT_EQ_SIZE_T(1000, json_get_object_size(&o));
+    for (i = 0; i < 1000; i ++) {
+        len = sprintf(key, "k%zu", i);
+        EXPECT_EQ_SIZE_T(i, json_find_object_index(&o, key, len));
+    }
+    EXPECT_EQ_TRUE(json_find_object_index(&o, "k1000", 5) == JSON_KEY_NOT_EXIST);
+    json_set_int64(json_set_object_value(&o, "k10", 3), -1); /* 已存在的键不会重复插入 */
+    EXPECT_EQ_SIZE_T(1000, json_get_object_size(&o));
+
+    for (i = 0; i < 1000; i += 2) {
+        len = sprintf(key, "k%zu", i);
+        json_remove_object_value(&o, json_find_object_index(&o, key, len));
+    }
+    EXPECT_EQ_SIZE_T(500, json_get_object_size(&o));
+    for (i = 0; i < 1000; i ++) {
+        len = sprintf(key, "k%zu", i);
+        n = json_find_object_index(&o, key, len);
+        if (i % 2 == 0) {
+            EXPECT_EQ_TRUE(n == JSON_KEY_NOT_EXIST);
+        } else {
+            EXPECT_EQ_TRUE(n != JSON_KEY_NOT_EXIST);
+            EXPECT_EQ_INT64((int64_t)i, json_get_int64(json_get_object_value(&o, n)));
+        }
+    }
+    json_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(500, json_get_object_capacity(&o));
+    EXPECT_EQ_TRUE(json_find_object_value(&o, "k999", 4) != NULL);
+
+    json_init(&o2);
+    json_copy(&o2, &o);
+    EXPECT_EQ_TRUE(json_is_equal(&o, &o2));
+    json_remove_object_value(&o2, 0);
+    EXPECT_EQ_FALSE(json_is_equal(&o, &o2));
+    json_free(&o2);
+
+    json_clear_object(&o);
+    EXPECT_EQ_TRUE(json_find_object_index(&o, "k1", 2) == JSON_KEY_NOT_EXIST);
+    json_set_null(json_set_object_value(&o, "k1", 2));
+    EXPECT_EQ_SIZE_T(0, json_find_object_index(&o, "k1", 2));
+    json_free(&o);
+
+    /* 解析出的大对象：重复的键返回第一个 */
+    len = 0;
+    json[len ++] = '{';
+    for (i = 0; i < 40; i ++) {
+        len += sprintf(json + len, "%s\"k%zu\":%zu", i ? "," : "", i % 30, i);
+    }
+    json[len ++] = '}';
+    json[len] = '\0';
+    json_init(&o);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&o, json));
+    for (i = 0; i < 30; i ++) {
+        len = sprintf(key, "k%zu", i);
+        EXPECT_EQ_SIZE_T(i, json_find_object_index(&o, key, len));
+    }
+    json_free(&o);
+
+    {
+        json_arena a;
+        json_arena_init(&a, 0);
+        json_init(&o);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_arena(&o, json, &a));
+        EXPECT_EQ_SIZE_T(29, json_find_object_index(&o, "k29", 3));
+        json_set_null(json_set_object_value(&o, "new", 3));
+        EXPECT_EQ_SIZE_T(40, json_find_object_index(&o, "new", 3));
+        EXPECT_EQ_SIZE_T(29, json_find_object_index(&o, "k29", 3));
+        json_free(&o);
+        json_arena_free(&a);
+    }
+}
+
+#define TEST_POINTER_FIND(error, expect, json, path)\
+    do {\
+        json_pointer* ptr = json_pointer_compile(path);\
+        json_value f, e;\
+        EXPECT_EQ_INT(error, json_pointer_find(&f, json, strlen(json), ptr));\
+        if ((error) == JSON_PARSE_OK) {\
+            json_init(&e);\
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, expect));\
+            EXPECT_EQ_TRUE(json_is_equal(&e, &f));\
+            json_free(&e);\
+        } else {\
+            EXPECT_EQ_INT(JSON_NULL, json_get_type(&f));\
+        }\
+        json_free(&f);\
+        json_pointer_free(ptr);\
+    } while(0)
+
+static void test_access_pointer() {
+    /* RFC 6901 第5节的例子 */
+    const char* json = "{ \"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1, \"c%d\": 2, \"e^f\": 3, \"g|h\": 4,"
+        " \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, \"m~n\": 8 }";
+    static const char* const paths[] = { "/foo/0", "/", "/a~1b", "/c%d", "/e^f", "/g|h", "/i\\j", "/k\"l", "/ ", "/m~0n" };
+    json_value v, *p;
+    json_pointer* ptr;
+    json_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+    ptr = json_pointer_compile("");
+    EXPECT_EQ_TRUE(json_pointer_get(&v, ptr) == &v);
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/foo");
+    EXPECT_EQ_SIZE_T(2, json_get_array_size(json_pointer_get(&v, ptr)));
+    json_pointer_free(ptr);
+    for (int i = 0; i < 10; i ++) {
+        char expect[8];
+        ptr = json_pointer_compile(paths[i]);
+        p = json_pointer_get(&v, ptr);
+        if (i == 0) {
+            EXPECT_EQ_STRING("bar", json_get_string(p), json_get_string_length(p));
+        } else {
+            EXPECT_EQ_DOUBLE((double)(i - 1), json_get_number(p));
+        }
+        snprintf(expect, sizeof(expect), i == 0 ? "\"bar\"" : "%d", i - 1);
+        TEST_POINTER_FIND(JSON_PARSE_OK, expect, json, paths[i]);
+        json_pointer_free(ptr);
+    }
+
+    /* 不存在的路径 */
+    static const char* const missing[] = { "/foo/2", "/foo/-", "/foo/01", "/foo/x", "/bar", "/a~1b/c", "/foo/99999999999999999999999" };
+    for (int i = 0; i < 7; i ++) {
+        ptr = json_pointer_compile(missing[i]);
+        EXPECT_EQ_TRUE(json_pointer_get(&v, ptr) == NULL);
+        json_pointer_free(ptr);
+        TEST_POINTER_FIND(JSON_PARSE_NOT_FOUND, "", json, missing[i]);
+    }
+    EXPECT_EQ_TRUE(json_pointer_compile("a") == NULL);
+    EXPECT_EQ_TRUE(json_pointer_compile("/a~2") == NULL);
+    EXPECT_EQ_TRUE(json_pointer_compile("/a~") == NULL);
+
+    /* 设置：创建不存在的成员和中间对象，"-"和size追加数组元素 */
+    ptr = json_pointer_compile("/x/y~1z");
+    json_set_number(json_pointer_set(&v, ptr), 9.0);
+    EXPECT_EQ_DOUBLE(9.0, json_get_number(json_pointer_get(&v, ptr)));
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/foo/-");
+    json_set_boolean(json_pointer_set(&v, ptr), 1);
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/foo/3");
+    json_set_boolean(json_pointer_set(&v, ptr), 0);
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/foo/1");
+    json_set_string(json_pointer_set(&v, ptr), "qux", 3);
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/foo/5");
+    EXPECT_EQ_TRUE(json_pointer_set(&v, ptr) == NULL);
+    json_pointer_free(ptr);
+    ptr = json_pointer_compile("/a~1b/c");
+    EXPECT_EQ_TRUE(json_pointer_set(&v, ptr) == NULL);
+    json_pointer_free(ptr);
+    json_value e;
+    json_init(&e);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&e, "[\"bar\", \"qux\", true, false]"));
+    ptr = json_pointer_compile("/foo");
+    EXPECT_EQ_TRUE(json_is_equal(&e, json_pointer_get(&v, ptr)));
+    json_pointer_free(ptr);
+    json_free(&e);
+    json_free(&v);
+
+    /* 直接在文本中查找：找到之后不再检查后面的内容，路径上的语法错误照常报告 */
+    TEST_POINTER_FIND(JSON_PARSE_OK, "[true]", "{\"a\":{\"b\":[1, {\"c\":[true]}]}} xx", "/a/b/1/c");
+    TEST_POINTER_FIND(JSON_PARSE_OK, "{\"b\":2}", " [ [\"]\", {}], 1.5, {\"b\":2}, ", "/2");
+    TEST_POINTER_FIND(JSON_PARSE_NOT_FOUND, "", "{\"a\":\"str\"}", "/a/0");
+    TEST_POINTER_FIND(JSON_PARSE_NOT_FOUND, "", "[]", "/0");
+    TEST_POINTER_FIND(JSON_PARSE_MISS_COLON, "", "{\"x\" 1, \"a\":2}", "/a");
+    TEST_POINTER_FIND(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "", "[1 2]", "/1");
+    TEST_POINTER_FIND(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "", "{\"x\":[1,2]", "/a");
+    TEST_POINTER_FIND(JSON_PARSE_INVALID_VALUE, "", "[1, tru]", "/1");
+}
 
 static void test_access() {
     test_access_null();
     test_access_boolean();
     test_access_number();
+    test_access_integer();
     test_access_string();
     test_access_array();
     test_access_object();
+    test_access_object_index();
+    test_access_pointer();
 }
 
 int main() {
@@ -692,8 +2378,38 @@ int main() {
     test_stringify();
     test_equal();
     test_copy();
+    test_cbor();
+    test_flat();
+    test_move();
+    test_swap();
+    test_allocator();
+    /* 使用计数分配器再跑一遍，所有内存都要经过分配器并且全部释放 */
+    test_alloc_stats stats = { 0, 0, 0, 0 };
+    json_allocator a = test_allocator_init;
+    a.ud = &stats;
+    json_set_allocator(&a);
+    test_parse();
+    test_access();
+    test_stringify();
+    test_equal();
+    test_copy();
+    test_cbor();
+    test_flat();
     test_move();
     test_swap();
+    test_allocator();
+    json_set_allocator(NULL);
+    EXPECT_ALLOC_BALANCED(stats);
+    /* 使用结构索引引擎把解析相关的测试再跑一遍，结果和错误码都应与递归下降相同 */
+    json_set_engine(JSON_ENGINE_INDEXED);
+    test_parse();
+    test_access();
+    test_stringify();
+    test_equal();
+    test_copy();
+    test_cbor();
+    test_flat();
+    json_set_engine(JSON_ENGINE_RECURSIVE);
     printf("---------xscJson test---------\n");
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
     printf("------------------------------\n");
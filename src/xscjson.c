@@ -1,10 +1,33 @@
 #include "xscjson.h"
 #include <assert.h>
 #include <stdlib.h>
-#include <errno.h>
 #include <math.h>
 #include <string.h>
-#include <stdio.h>
+#include <stdint.h>
+#include <float.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSON_HAS_X86_SIMD 1
+#endif
+
+#if !defined(JSON_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#include <pthread.h>
+#include <unistd.h>
+#define JSON_HAS_PTHREAD 1
+#endif
+
+// 按CPU选择的SIMD实现在第一次调用时才确定，可能有多个线程同时写入，用relaxed原子操作读写
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define JSON_ATOMIC(type) _Atomic(type)
+#define JSON_LOAD_RELAXED(x) atomic_load_explicit(&(x), memory_order_relaxed)
+#define JSON_STORE_RELAXED(x, v) atomic_store_explicit(&(x), v, memory_order_relaxed)
+#else
+#define JSON_ATOMIC(type) type
+#define JSON_LOAD_RELAXED(x) (x)
+#define JSON_STORE_RELAXED(x, v) ((x) = (v))
+#endif
 
 #ifndef JSON_PARSE_STACK_INIT_SIZE
 #define JSON_PARSE_STACK_INIT_SIZE 256
@@ -14,20 +37,210 @@
 #define JSON_STRINGIFY_STACK_INIT_SIZE 256
 #endif
 
+#ifndef JSON_WRITER_BUFFER_SIZE
+#define JSON_WRITER_BUFFER_SIZE 16384 /* json_stringify_to每次交给writer的最大字节数 */
+#endif
+
+#ifndef JSON_PARSE_MAX_DEPTH
+#define JSON_PARSE_MAX_DEPTH 1024 /* 数组、对象嵌套层数的默认上限 */
+#endif
+
+#ifndef JSON_OBJECT_INDEX_THRESHOLD
+#define JSON_OBJECT_INDEX_THRESHOLD 16 /* 成员数量达到该值的对象建立哈希索引 */
+#endif
+
+#ifndef JSON_NDJSON_BATCH
+#define JSON_NDJSON_BATCH 256 /* NDJSON每批每个线程分到的记录数 */
+#endif
+
+#ifndef JSON_NDJSON_GRAIN
+#define JSON_NDJSON_GRAIN 16 /* 线程每次领取的记录数 */
+#endif
+
+#ifndef JSON_ARENA_BLOCK_SIZE
+#define JSON_ARENA_BLOCK_SIZE 4096
+#endif
+
+#define JSON_ARENA_ALIGN 8
+#define JSON_ARENA_ROUND(n) (((n) + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1))
+
+#define JSON_FLAG_BORROWED      0x1 /* u.s.s/u.a.e/u.o.m 不归json_value所有，不能free */
+#define JSON_FLAG_BORROWED_KEYS 0x2 /* 对象成员的键不归json_value所有 */
+#define JSON_FLAG_INT64         0x4 /* JSON_NUMBER的值保存在u.i中 */
+#define JSON_FLAG_UINT64        0x8 /* JSON_NUMBER的值保存在u.ui中(大于INT64_MAX) */
+#define JSON_FLAG_INTEGER       (JSON_FLAG_INT64 | JSON_FLAG_UINT64)
+#define JSON_FLAG_INDEXED       0x10 /* 对象成员数组之后紧跟着键的哈希索引 */
+#define JSON_FLAG_LAZY          0x20 /* 延迟解析，u.s.s指向这个值自己的json_lazy单元 */
+
 #define EXPECT(c, ch) do { assert(*c->json == (ch)); c->json ++;} while(0)
 #define ISDIGIT(ch) ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT_1TO9(ch) ((ch) >= '1' && (ch) <= '9')
+#define PEEK(c, p) ((p) != (c)->end ? *(p) : '\0') // 到达结尾时当作'\0'，语法中任何位置都不接受它
 #define PUTC(c, ch) do { *(char*)json_context_push(c, sizeof(char)) = (ch); } while(0)
 #define PUTS(c, s, len) memcpy(json_context_push(c, len), s, len)
+#define SAX_CALL(c, cb, args) ((c)->sax->cb == NULL || (c)->sax->cb args) // 未设置的回调当作继续
+
+// 对象的哈希索引和成员数组在同一块内存中：capacity个成员之后是json_object_index_slots(capacity)个槽，
+// 槽中保存成员下标+1(0为空槽)，使用线性探测，装载因子不超过1/2
+static size_t json_object_index_slots(size_t capacity) {
+    size_t n = 8;
+    while (n < capacity * 2) {
+        n <<= 1;
+    }
+    return n;
+}
+static size_t json_object_bytes(size_t capacity, int indexed) {
+    return capacity * sizeof(json_member) + (indexed ? json_object_index_slots(capacity) * sizeof(uint32_t) : 0);
+}
+#define JSON_OBJECT_INDEX(v) ((uint32_t*)((v)->u.o.m + (v)->u.o.capacity))
+static uint32_t json_hash_key(const char* k, size_t klen) { // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < klen; i ++) {
+        h = (h ^ (unsigned char)k[i]) * 16777619u;
+    }
+    return h;
+}
+static void json_object_index_insert(json_value* v, size_t index) {
+    uint32_t* slots = JSON_OBJECT_INDEX(v);
+    size_t mask = json_object_index_slots(v->u.o.capacity) - 1;
+    size_t h = json_hash_key(v->u.o.m[index].k, v->u.o.m[index].klen) & mask;
+    while (slots[h] != 0) {
+        h = (h + 1) & mask;
+    }
+    slots[h] = (uint32_t)(index + 1);
+}
+static void json_object_rebuild_index(json_value* v) {
+    memset(JSON_OBJECT_INDEX(v), 0, json_object_index_slots(v->u.o.capacity) * sizeof(uint32_t));
+    for (size_t i = 0; i < v->u.o.size; i ++) {
+        json_object_index_insert(v, i);
+    }
+}
 
 typedef struct {
     const char* json;
+    const char* end;
     char* stack;
     size_t size, top;
+    json_arena* arena;
+    json_key_pool* pool;
+    const json_sax_handler* sax; // 非NULL时为SAX模式，只产生事件不建立json_value树
+    void* ud;
+    int lazy;          // 数组、对象、字符串只记录原文，用到时再解析
+    const char* const* keys; // 非NULL时对象中键不在这个列表(以NULL结尾)中的成员直接跳过
+    int insitu;
+    json_writer_fn writer; // 非NULL时stack是固定大小的输出缓冲区，写满就交给writer
+    int stopped;           // writer返回了0，之后的输出都丢弃
+    unsigned format;       // JSON_STRINGIFY_*
+    unsigned indent;       // 每层缩进的空格数，0为紧凑格式
+    size_t depth;          // 生成时为缩进层数，解析时为当前所在的数组、对象层数
+    size_t max_depth;
+    const json_allocator* alloc; // stack的分配器
 } json_context;
 
+static json_engine json_parse_engine = JSON_ENGINE_RECURSIVE;
+void json_set_engine(json_engine engine) {
+    json_parse_engine = engine;
+}
+json_engine json_get_engine(void) {
+    return json_parse_engine;
+}
+
+static size_t json_max_depth = JSON_PARSE_MAX_DEPTH;
+void json_set_max_depth(size_t depth) {
+    json_max_depth = depth;
+}
+size_t json_get_max_depth(void) {
+    return json_max_depth;
+}
+
+static void* json_std_malloc(void* ud, size_t size) {
+    (void)ud;
+    return malloc(size);
+}
+static void* json_std_realloc(void* ud, void* ptr, size_t size) {
+    (void)ud;
+    return realloc(ptr, size);
+}
+static void json_std_free(void* ud, void* ptr) {
+    (void)ud;
+    free(ptr);
+}
+static json_allocator json_global_allocator = { json_std_malloc, json_std_realloc, json_std_free, NULL };
+void json_set_allocator(const json_allocator* a) {
+    if (a == NULL) {
+        json_global_allocator.malloc = json_std_malloc;
+        json_global_allocator.realloc = json_std_realloc;
+        json_global_allocator.free = json_std_free;
+        json_global_allocator.ud = NULL;
+    } else {
+        assert(a->malloc != NULL && a->realloc != NULL && a->free != NULL);
+        json_global_allocator = *a;
+    }
+}
+const json_allocator* json_get_allocator(void) {
+    return &json_global_allocator;
+}
+// 分配器的realloc和free不会收到NULL
+static void* json_alloc_malloc(const json_allocator* a, size_t size) {
+    return a->malloc(a->ud, size);
+}
+static void* json_alloc_realloc(const json_allocator* a, void* ptr, size_t size) {
+    return ptr == NULL ? a->malloc(a->ud, size) : a->realloc(a->ud, ptr, size);
+}
+static void json_alloc_free(const json_allocator* a, void* ptr) {
+    if (ptr != NULL) {
+        a->free(a->ud, ptr);
+    }
+}
+static void* json_alloc_calloc(const json_allocator* a, size_t n, size_t size) {
+    if (size != 0 && n > SIZE_MAX / size) { // n * size溢出时回绕成一个小的缓冲区，调用者仍按n个元素访问
+        return NULL;
+    }
+    void* ret = a->malloc(a->ud, n * size);
+    if (ret != NULL) {
+        memset(ret, 0, n * size);
+    }
+    return ret;
+}
+#define JSON_MALLOC(size) json_alloc_malloc(&json_global_allocator, size)
+#define JSON_REALLOC(ptr, size) json_alloc_realloc(&json_global_allocator, ptr, size)
+#define JSON_FREE(ptr) json_alloc_free(&json_global_allocator, ptr)
+#define JSON_CALLOC(n, size) json_alloc_calloc(&json_global_allocator, n, size)
+void json_free_buffer(void* p) {
+    JSON_FREE(p);
+}
+
+static void json_context_init(json_context* c, const char* json, size_t len) {
+    c->json = json;
+    c->end = json + len;
+    c->stack = NULL;
+    c->size = c->top = 0;
+    c->arena = NULL;
+    c->pool = NULL;
+    c->sax = NULL;
+    c->ud = NULL;
+    c->lazy = 0;
+    c->keys = NULL;
+    c->insitu = 0;
+    c->writer = NULL;
+    c->stopped = 0;
+    c->format = c->indent = 0;
+    c->depth = 0;
+    c->max_depth = json_max_depth == 0 ? SIZE_MAX : json_max_depth;
+    c->alloc = &json_global_allocator;
+}
+
+static void json_context_flush(json_context* c) {
+    if (c->top > 0 && !c->stopped && !c->writer(c->ud, c->stack, c->top)) {
+        c->stopped = 1;
+    }
+    c->top = 0;
+}
 static void* json_context_push(json_context* c, size_t size) {
     assert(size > 0);
+    if (c->writer != NULL && c->top + size >= c->size) {
+        json_context_flush(c);
+    }
     if (c->top + size >= c->size) {
         if (c->size == 0) {
             c->size = JSON_PARSE_STACK_INIT_SIZE;
@@ -35,7 +248,7 @@ static void* json_context_push(json_context* c, size_t size) {
         while (c->top + size >= c->size) {
             c->size += c->size >> 1;
         }
-        c->stack = (char*)realloc(c->stack, c->size);
+        c->stack = (char*)json_alloc_realloc(c->alloc, c->stack, c->size);
     }
     void* ret = c->stack + c->top;
     c->top += size;
@@ -46,9 +259,139 @@ static void* json_context_pop(json_context* c, size_t size) {
     return c->stack + (c->top -= size);
 }
 
+struct json_arena_block {
+    json_arena_block* next;
+    size_t size, used;
+};
+#define JSON_ARENA_HEADER JSON_ARENA_ROUND(sizeof(json_arena_block))
+
+void json_arena_init(json_arena* a, size_t block_size) {
+    assert(a != NULL);
+    a->head = a->cur = NULL;
+    a->block_size = block_size > 0 ? block_size : JSON_ARENA_BLOCK_SIZE;
+    a->stack = NULL;
+    a->stack_size = 0;
+    a->allocator = json_global_allocator;
+}
+void json_arena_reset(json_arena* a) {
+    assert(a != NULL);
+    for (json_arena_block* b = a->head; b != NULL; b = b->next) {
+        b->used = 0;
+    }
+    a->cur = a->head;
+}
+void json_arena_free(json_arena* a) {
+    assert(a != NULL);
+    json_arena_block* b = a->head;
+    while (b != NULL) {
+        json_arena_block* next = b->next;
+        json_alloc_free(&a->allocator, b);
+        b = next;
+    }
+    json_alloc_free(&a->allocator, a->stack);
+    a->head = a->cur = NULL; // 保留block_size和allocator，之后可以继续使用
+    a->stack = NULL;
+    a->stack_size = 0;
+}
+static void* json_arena_alloc(json_arena* a, size_t size) {
+    size = JSON_ARENA_ROUND(size);
+    json_arena_block* b = a->cur;
+    if (b == NULL || b->used + size > b->size) {
+        // cur之后的块在reset之后都是空的，放得下就复用，否则插入一个新块
+        json_arena_block* next = b != NULL ? b->next : a->head;
+        if (next != NULL && next->size >= size) {
+            b = next;
+        } else {
+            size_t bsize = size > a->block_size ? size : a->block_size;
+            json_arena_block* nb = (json_arena_block*)json_alloc_malloc(&a->allocator, JSON_ARENA_HEADER + bsize);
+            nb->size = bsize;
+            nb->used = 0;
+            nb->next = next;
+            if (b != NULL) {
+                b->next = nb;
+            } else {
+                a->head = nb;
+            }
+            b = nb;
+        }
+        a->cur = b;
+    }
+    void* ret = (char*)b + JSON_ARENA_HEADER + b->used;
+    b->used += size;
+    return ret;
+}
+
+struct json_key_entry {
+    const char* k;
+    size_t klen;
+    uint32_t hash;
+};
+
+void json_key_pool_init(json_key_pool* pool) {
+    assert(pool != NULL);
+    json_arena_init(&pool->keys, 0);
+    pool->slots = NULL;
+    pool->size = pool->capacity = 0;
+}
+void json_key_pool_free(json_key_pool* pool) {
+    assert(pool != NULL);
+    json_alloc_free(&pool->keys.allocator, pool->slots);
+    json_arena_free(&pool->keys);
+    pool->slots = NULL;
+    pool->size = pool->capacity = 0;
+}
+const char* json_key_pool_intern(json_key_pool* pool, const char* key, size_t klen) {
+    assert(pool != NULL && (key != NULL || klen == 0));
+    if (pool->size * 2 >= pool->capacity) { // 装载因子不超过1/2，扩容时重新散列
+        size_t capacity = pool->capacity == 0 ? 64 : pool->capacity * 2;
+        json_key_entry* slots = (json_key_entry*)json_alloc_calloc(&pool->keys.allocator, capacity, sizeof(json_key_entry));
+        if (slots == NULL) { // 表无法再扩容，pool保持不变
+            return NULL;
+        }
+        for (size_t i = 0; i < pool->capacity; i ++) {
+            if (pool->slots[i].k != NULL) {
+                size_t h = pool->slots[i].hash & (capacity - 1);
+                while (slots[h].k != NULL) {
+                    h = (h + 1) & (capacity - 1);
+                }
+                slots[h] = pool->slots[i];
+            }
+        }
+        json_alloc_free(&pool->keys.allocator, pool->slots);
+        pool->slots = slots;
+        pool->capacity = capacity;
+    }
+    uint32_t hash = json_hash_key(key, klen);
+    size_t mask = pool->capacity - 1, h = hash & mask;
+    for (; pool->slots[h].k != NULL; h = (h + 1) & mask) {
+        json_key_entry* e = &pool->slots[h];
+        if (e->hash == hash && e->klen == klen && memcmp(e->k, key, klen) == 0) {
+            return e->k;
+        }
+    }
+    char* k = (char*)json_arena_alloc(&pool->keys, klen + 1);
+    memcpy(k, key, klen);
+    k[klen] = '\0';
+    pool->slots[h].k = k;
+    pool->slots[h].klen = klen;
+    pool->slots[h].hash = hash;
+    pool->size ++;
+    return k;
+}
+
+static void* json_context_alloc(json_context* c, size_t size) {
+    return c->arena != NULL ? json_arena_alloc(c->arena, size) : JSON_MALLOC(size);
+}
+static char* json_context_strdup(json_context* c, const char* s, size_t len) {
+    char* ret = (char*)json_context_alloc(c, len + 1);
+    memcpy(ret, s, len);
+    ret[len] = '\0';
+    return ret;
+}
+
 static void json_parse_whitespace(json_context* c) {
     const char* p = c->json;
-    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+    while (p != c->end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
         ++ p;
     }
     c->json = p;
@@ -57,7 +400,7 @@ static int json_parse_literal(json_context* c, json_value* v, const char* litera
     EXPECT(c, literal[0]);
     int i = 1;
     while (literal[i] != '\0') {
-        if (literal[i] != *c->json) {
+        if (literal[i] != PEEK(c, c->json)) {
             return JSON_PARSE_INVALID_VALUE;
         } else {
             c->json ++;
@@ -67,47 +410,119 @@ static int json_parse_literal(json_context* c, json_value* v, const char* litera
     v->type = type;
     return JSON_PARSE_OK;
 }
+// 整数能用int64/uint64精确表示时保存为整数，否则返回0交给浮点数路径
+static int json_parse_integer(const char* p, const char* end, int neg, int truncated, uint64_t m, json_value* v) {
+    if (truncated) { // 超过19位，只有20位且不超过UINT64_MAX的正数还能表示
+        if (neg || end - p != 20) {
+            return 0;
+        }
+        m = 0;
+        for (; p != end; p ++) {
+            unsigned d = *p - '0';
+            if (m > (UINT64_MAX - d) / 10) {
+                return 0;
+            }
+            m = m * 10 + d;
+        }
+    }
+    if (neg) {
+        if (m > (uint64_t)INT64_MAX + 1) {
+            return 0;
+        }
+        v->u.i = (int64_t)(0 - m);
+        v->flags |= JSON_FLAG_INT64;
+    } else if (m <= INT64_MAX) {
+        v->u.i = (int64_t)m;
+        v->flags |= JSON_FLAG_INT64;
+    } else {
+        v->u.ui = m;
+        v->flags |= JSON_FLAG_UINT64;
+    }
+    return 1;
+}
+static int json_strtod(const char* p, const char* end, double* d);
+// 有效数字不超过19位时记录在m中，多出的数字只影响十进制指数，之后交给json_strtod处理
+#define NUMBER_DIGIT(ch) do { if (digits < 19) { m = m * 10 + ((ch) - '0'); digits += m != 0; } else { truncated = 1; exp10 ++; } } while(0)
 static int json_parse_number(json_context* c, json_value* v) {
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
     const char* p = c->json;
-    if (*p == '-') {
+    int neg = 0, digits = 0, truncated = 0, exp10 = 0, integer = 1;
+    uint64_t m = 0;
+    if (PEEK(c, p) == '-') {
+        neg = 1;
         p ++;
     }
-    if (*p == '0') {
+    if (PEEK(c, p) == '0') {
         p ++;
     } else {
-        if (!ISDIGIT_1TO9(*p)) {
+        if (!ISDIGIT_1TO9(PEEK(c, p))) {
             return JSON_PARSE_INVALID_VALUE;
         }
-        for (p ++; ISDIGIT(*p); p ++);
+        for (; ISDIGIT(PEEK(c, p)); p ++) {
+            NUMBER_DIGIT(*p);
+        }
     }
-    if (*p == '.') {
+    if (PEEK(c, p) == '.') {
+        integer = 0;
         p ++;
-        if (!ISDIGIT(*p)) {
+        if (!ISDIGIT(PEEK(c, p))) {
             return JSON_PARSE_INVALID_VALUE;
         }
-        for (p ++; ISDIGIT(*p); p ++);
+        for (; ISDIGIT(PEEK(c, p)); p ++) {
+            NUMBER_DIGIT(*p);
+            exp10 --;
+        }
     }
-    if (*p == 'e' || *p == 'E') {
+    if (PEEK(c, p) == 'e' || PEEK(c, p) == 'E') {
+        int eneg = 0, e = 0;
+        integer = 0;
         p ++;
-        if (*p == '+' || *p == '-') {
+        if (PEEK(c, p) == '+' || PEEK(c, p) == '-') {
+            eneg = *p == '-';
             p ++;
         }
-        if (!ISDIGIT(*p)) {
+        if (!ISDIGIT(PEEK(c, p))) {
             return JSON_PARSE_INVALID_VALUE;
         }
-        for (p ++; ISDIGIT(*p); p ++);
+        for (; ISDIGIT(PEEK(c, p)); p ++) {
+            if (e < 100000) { // 再大也只能是溢出或下溢，防止int溢出
+                e = e * 10 + (*p - '0');
+            }
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (integer && (m != 0 || !neg) && json_parse_integer(c->json + neg, p, neg, truncated, m, v)) {
+        // 整数直接保存为int64/uint64，不经过double
+    } else if (!truncated && m == 0) {
+        v->u.n = neg ? -0.0 : 0.0;
+    }
+#if FLT_EVAL_METHOD == 0
+    // m和10^|exp10|都能用double精确表示时，一次乘除法就是正确舍入的结果(Clinger快速路径)
+    else if (!truncated && m <= ((uint64_t)1 << 53) && exp10 >= -22 && exp10 <= 22) {
+        double d = (double)m;
+        d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+        v->u.n = neg ? -d : d;
     }
-    errno = 0;
-    v->u.n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL)) {
-        return JSON_PARSE_NUMBER_TOO_BIG;
+#endif
+    else {
+        double d;
+        if (!json_strtod(c->json + neg, p, &d)) {
+            return JSON_PARSE_NUMBER_TOO_BIG;
+        }
+        v->u.n = neg ? -d : d;
     }
     v->type = JSON_NUMBER;
     c->json = p;
     return JSON_PARSE_OK;
 }
-static const char* json_parse_hex4(const char* p, unsigned* u) {
+static const char* json_parse_hex4(const char* p, const char* end, unsigned* u) {
     *u = 0;
+    if (end - p < 4) {
+        return NULL;
+    }
     for (int i = 0; i < 4; i++) {
         char ch = *p++;
         *u <<= 4;
@@ -118,367 +533,3355 @@ static const char* json_parse_hex4(const char* p, unsigned* u) {
     }
     return p;
 }
-static void json_encode_utf8(json_context* c, unsigned u) {
+static char* json_encode_utf8(char* p, unsigned u) {
     if (u < 0x0080) {
-        PUTC(c, 0x00 | (u & 0x7f));
+        *p ++ = 0x00 | (u & 0x7f);
     } else if (u >= 0x0080 && u < 0x0800) {
-        PUTC(c, 0xc0 | ((u >> 6 ) & 0x1f));
-        PUTC(c, 0x80 | ((u      ) & 0x3f));
+        *p ++ = 0xc0 | ((u >> 6 ) & 0x1f);
+        *p ++ = 0x80 | ((u      ) & 0x3f);
     } else if (u >= 0x0800 && u < 0x10000) {
-        PUTC(c, 0xe0 | ((u >> 12) & 0xff));
-        PUTC(c, 0x80 | ((u >> 6 ) & 0x3f));
-        PUTC(c, 0x80 | ((u      ) & 0x3f));
+        *p ++ = 0xe0 | ((u >> 12) & 0xff);
+        *p ++ = 0x80 | ((u >> 6 ) & 0x3f);
+        *p ++ = 0x80 | ((u      ) & 0x3f);
     } else if (u >= 0x10000 && u <= 0x10ffff) {
-        PUTC(c, 0xf0 | ((u >> 18) & 0x07));
-        PUTC(c, 0x80 | ((u >> 12) & 0x3f));
-        PUTC(c, 0x80 | ((u >> 6 ) & 0x3f));
-        PUTC(c, 0x80 | ((u      ) & 0x3f));
+        *p ++ = 0xf0 | ((u >> 18) & 0x07);
+        *p ++ = 0x80 | ((u >> 12) & 0x3f);
+        *p ++ = 0x80 | ((u >> 6 ) & 0x3f);
+        *p ++ = 0x80 | ((u      ) & 0x3f);
+    }
+    return p;
+}
+// 在[p, end)中找到第一个'"'、'\\'或控制字符，返回其位置(没有则返回end)
+typedef const char* (*json_scan_fn)(const char* p, const char* end);
+
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGH 0x8080808080808080ULL
+#define SWAR_HAS_ZERO(x) (((x) - SWAR_ONES) & ~(x) & SWAR_HIGH)
+#define SWAR_HAS_LESS(x, n) (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGH)
+static const char* json_scan_string_tail(const char* p, const char* end) {
+    for (; p != end; p ++) {
+        unsigned char ch = (unsigned char)*p;
+        if (ch == '\"' || ch == '\\' || ch < 0x20) {
+            break;
+        }
+    }
+    return p;
+}
+static const char* json_scan_string_scalar(const char* p, const char* end) {
+    while (end - p >= 8) { // 一次检查8个字节
+        uint64_t x;
+        memcpy(&x, p, 8);
+        if (SWAR_HAS_ZERO(x ^ (SWAR_ONES * '\"')) | SWAR_HAS_ZERO(x ^ (SWAR_ONES * '\\')) | SWAR_HAS_LESS(x, 0x20)) {
+            return json_scan_string_tail(p, p + 8);
+        }
+        p += 8;
+    }
+    return json_scan_string_tail(p, end);
+}
+#ifdef JSON_HAS_X86_SIMD
+__attribute__((target("sse2")))
+static const char* json_scan_string_sse2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1f);
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, slash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl)); // x <= 0x1f
+        int mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return json_scan_string_tail(p, end);
+}
+__attribute__((target("avx2")))
+static const char* json_scan_string_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i ctrl = _mm256_set1_epi8(0x1f);
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(x, slash));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_max_epu8(x, ctrl), ctrl));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return json_scan_string_sse2(p, end);
+}
+#endif
+static const char* json_scan_string_resolve(const char* p, const char* end);
+static JSON_ATOMIC(json_scan_fn) json_scan_string_impl = json_scan_string_resolve;
+static const char* json_scan_string(const char* p, const char* end) {
+    return JSON_LOAD_RELAXED(json_scan_string_impl)(p, end);
+}
+// 第一次调用时按CPU选择实现，之后直接调用选中的实现；多个线程同时选择时写入的是同一个值
+static const char* json_scan_string_resolve(const char* p, const char* end) {
+    json_scan_fn fn = json_scan_string_scalar;
+#ifdef JSON_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = json_scan_string_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        fn = json_scan_string_sse2;
+    }
+#endif
+    JSON_STORE_RELAXED(json_scan_string_impl, fn);
+    return fn(p, end);
+}
+
+// 跳过值时只关心引号和括号：'['|0x20 == '{'，']'|0x20 == '}'，所以只需要比较三个字节
+static const char* json_scan_structure_tail(const char* p, const char* end) {
+    for (; p != end; p ++) {
+        char ch = *p | 0x20;
+        if (*p == '\"' || ch == '{' || ch == '}') {
+            break;
+        }
+    }
+    return p;
+}
+static const char* json_scan_structure_scalar(const char* p, const char* end) {
+    while (end - p >= 8) {
+        uint64_t x, y;
+        memcpy(&x, p, 8);
+        y = x | (SWAR_ONES * 0x20);
+        if (SWAR_HAS_ZERO(x ^ (SWAR_ONES * '\"')) | SWAR_HAS_ZERO(y ^ (SWAR_ONES * '{')) | SWAR_HAS_ZERO(y ^ (SWAR_ONES * '}'))) {
+            return json_scan_structure_tail(p, p + 8);
+        }
+        p += 8;
+    }
+    return json_scan_structure_tail(p, end);
+}
+#ifdef JSON_HAS_X86_SIMD
+__attribute__((target("sse2")))
+static const char* json_scan_structure_sse2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i y = _mm_or_si128(x, lower);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(y, open));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(y, close));
+        int mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return json_scan_structure_tail(p, end);
+}
+__attribute__((target("avx2")))
+static const char* json_scan_structure_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        __m256i y = _mm256_or_si256(x, lower);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(y, open));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(y, close));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return json_scan_structure_sse2(p, end);
+}
+#endif
+static const char* json_scan_structure_resolve(const char* p, const char* end);
+static JSON_ATOMIC(json_scan_fn) json_scan_structure_impl = json_scan_structure_resolve;
+static const char* json_scan_structure(const char* p, const char* end) {
+    return JSON_LOAD_RELAXED(json_scan_structure_impl)(p, end);
+}
+static const char* json_scan_structure_resolve(const char* p, const char* end) {
+    json_scan_fn fn = json_scan_structure_scalar;
+#ifdef JSON_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = json_scan_structure_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        fn = json_scan_structure_sse2;
+    }
+#endif
+    JSON_STORE_RELAXED(json_scan_structure_impl, fn);
+    return fn(p, end);
+}
+
+/* 结构索引(JSON_ENGINE_INDEXED的第一阶段)：每64字节一块求出引号、反斜杠、空白和{}[]:,的位图，
+   由反斜杠求出被转义的字符，未转义的引号做前缀异或得到字符串内部的掩码，
+   再从中取出字符串之外的{}[]:,、所有未转义的引号和字符串之外标量(数字、字面量)的第一个字节，依次记下它们的偏移 */
+#ifndef JSON_INDEX_WINDOW
+#define JSON_INDEX_WINDOW 65536 /* 每次建立索引的输入字节数，必须是64的倍数 */
+#endif
+typedef struct {
+    uint64_t quote, backslash, space, op;
+} json_index_bits;
+typedef void (*json_classify_fn)(const char* p, json_index_bits* b);
+
+static void json_classify_scalar(const char* p, json_index_bits* b) {
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < 64; i ++) {
+        unsigned char ch = (unsigned char)p[i];
+        uint64_t bit = (uint64_t)1 << i;
+        b->quote |= ch == '\"' ? bit : 0;
+        b->backslash |= ch == '\\' ? bit : 0;
+        b->space |= ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' ? bit : 0;
+        b->op |= (ch | 0x20) == '{' || (ch | 0x20) == '}' || ch == ':' || ch == ',' ? bit : 0;
+    }
+}
+#ifdef JSON_HAS_X86_SIMD
+__attribute__((target("sse2")))
+static void json_classify_sse2(const char* p, json_index_bits* b) {
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < 64; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i y = _mm_or_si128(x, lower);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+        space = _mm_or_si128(space, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))));
+        __m128i op = _mm_or_si128(_mm_cmpeq_epi8(y, _mm_set1_epi8('{')), _mm_cmpeq_epi8(y, _mm_set1_epi8('}')));
+        op = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(':')), _mm_cmpeq_epi8(x, _mm_set1_epi8(','))));
+        b->quote |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote)) << i;
+        b->backslash |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, slash)) << i;
+        b->space |= (uint64_t)(unsigned)_mm_movemask_epi8(space) << i;
+        b->op |= (uint64_t)(unsigned)_mm_movemask_epi8(op) << i;
+    }
+}
+__attribute__((target("avx2")))
+static void json_classify_avx2(const char* p, json_index_bits* b) {
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < 64; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i y = _mm256_or_si256(x, lower);
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+        space = _mm256_or_si256(space, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r'))));
+        __m256i op = _mm256_or_si256(_mm256_cmpeq_epi8(y, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(y, _mm256_set1_epi8('}')));
+        op = _mm256_or_si256(op, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(','))));
+        b->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote)) << i;
+        b->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, slash)) << i;
+        b->space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(space) << i;
+        b->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+    }
+}
+#endif
+static void json_classify_resolve(const char* p, json_index_bits* b);
+static JSON_ATOMIC(json_classify_fn) json_classify_impl = json_classify_resolve;
+static void json_classify_resolve(const char* p, json_index_bits* b) {
+    json_classify_fn fn = json_classify_scalar;
+#ifdef JSON_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = json_classify_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        fn = json_classify_sse2;
+    }
+#endif
+    JSON_STORE_RELAXED(json_classify_impl, fn);
+    fn(p, b);
+}
+// 前缀异或：结果的第i位是x的第0..i位的异或
+static uint64_t json_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+// 跨块、跨窗口的状态，窗口总是从块的边界开始
+typedef struct {
+    const char* base;   // 当前窗口的开头，索引中保存相对它的偏移
+    const char* next;   // 下一个窗口的开头
+    const char* end;
+    size_t count, pos;  // 当前窗口的索引个数和下一个要读的下标
+    uint64_t escaped;   // 上一块最后是奇数个反斜杠，这一块的第一个字节被转义
+    uint64_t in_string; // 上一块结束在字符串中时为全1
+    uint64_t scalar;    // 上一块的最后一个字节属于标量
+} json_index;
+static void json_index_init(json_index* ix, const char* json, const char* end) {
+    ix->base = ix->next = json;
+    ix->end = end;
+    ix->count = ix->pos = 0;
+    ix->escaped = ix->in_string = ix->scalar = 0;
+}
+// 为下一个窗口建立索引，写入tape(至少能放下JSON_INDEX_WINDOW个偏移)
+static void json_index_window(json_index* ix, uint32_t* tape) {
+    const uint64_t even = 0x5555555555555555ULL;
+    json_classify_fn classify = JSON_LOAD_RELAXED(json_classify_impl);
+    size_t n = (size_t)(ix->end - ix->next) < JSON_INDEX_WINDOW ? (size_t)(ix->end - ix->next) : JSON_INDEX_WINDOW;
+    size_t count = 0;
+    ix->base = ix->next;
+    ix->next += n;
+    for (size_t off = 0; off < n; off += 64) {
+        json_index_bits b;
+        if (n - off >= 64) {
+            classify(ix->base + off, &b);
+        } else { // 最后不足64字节的一块用空白补齐
+            char buf[64];
+            memset(buf, ' ', sizeof(buf));
+            memcpy(buf, ix->base + off, n - off);
+            classify(buf, &b);
+        }
+        // 奇数个连续反斜杠之后的字节被转义：从偶数位开始的反斜杠序列加上自己后进位落在序列之后的位置
+        uint64_t backslash = b.backslash & ~ix->escaped;
+        uint64_t follows = backslash << 1 | ix->escaped;
+        uint64_t odd_starts = backslash & ~even & ~follows;
+        uint64_t even_starts;
+        ix->escaped = __builtin_add_overflow(odd_starts, backslash, &even_starts);
+        uint64_t escaped = (even ^ (even_starts << 1)) & follows;
+        // 字符串内部(含开引号，不含闭引号)
+        uint64_t quote = b.quote & ~escaped;
+        uint64_t in = json_prefix_xor(quote) ^ ix->in_string;
+        ix->in_string = (uint64_t)((int64_t)in >> 63);
+        uint64_t other = ~(b.space | b.op | quote | in);
+        uint64_t starts = other & ~(other << 1 | ix->scalar);
+        ix->scalar = other >> 63;
+        uint64_t tokens = (b.op & ~in) | quote | starts;
+        while (tokens != 0) {
+            tape[count ++] = (uint32_t)(off + __builtin_ctzll(tokens));
+            tokens &= tokens - 1;
+        }
     }
+    ix->count = count;
+    ix->pos = 0;
 }
-#define STRING_ERROR(ret) do { c->top = head; return ret; } while(0)
+
+#define STRING_ERROR(ret, at) do { c->top = head; c->json = (at); return ret; } while(0) // 出错时c->json指向出错的字符
+// 原地解析时w指向输入缓冲区中的写位置，解码后的字符串不会比原文长，所以w永远不会超过p
+#define STRING_PUTC(ch) do { if (w != NULL) *w ++ = (ch); else PUTC(c, ch); } while(0)
 static int json_parse_string_raw(json_context* c, char** str, size_t* len) {
     size_t head = c->top;
     EXPECT(c, '\"');
     const char* p = c->json;
+    char* w = c->insitu ? (char*)p : NULL;
     for (;;) {
+        const char* q = json_scan_string(p, c->end);
+        if (q != p) { // 不需要处理的连续字符整段拷贝
+            if (w != NULL) {
+                if (w != p) {
+                    memmove(w, p, q - p);
+                }
+                w += q - p;
+            } else {
+                PUTS(c, p, q - p);
+            }
+            p = q;
+        }
+        if (p == c->end) {
+            STRING_ERROR(JSON_PARSE_MISS_QUOTATION_MARK, p);
+        }
         char ch = *p ++;
         switch (ch) {
             case '\"': {
-                *len = c->top - head; 
-                *str = json_context_pop(c, *len);
+                if (w != NULL) {
+                    *len = w - c->json;
+                    *str = (char*)c->json;
+                    *w = '\0';
+                } else {
+                    *len = c->top - head; 
+                    *str = json_context_pop(c, *len);
+                }
                 c->json = p;
                 return JSON_PARSE_OK;
             }
-            case '\0': STRING_ERROR(JSON_PARSE_MISS_QUOTATION_MARK);
             case '\\': {
-                switch (*p ++) {
-                    case '\"': PUTC(c, '\"'); break;
-                    case '\\': PUTC(c, '\\'); break;
-                    case '/':  PUTC(c, '/');  break;
-                    case 'b':  PUTC(c, '\b'); break;
-                    case 'f':  PUTC(c, '\f'); break;
-                    case 'n':  PUTC(c, '\n'); break;
-                    case 'r':  PUTC(c, '\r'); break;
-                    case 't':  PUTC(c, '\t'); break;
+                const char* escape = p - 1;
+                char esc = PEEK(c, p);
+                p ++;
+                switch (esc) {
+                    case '\"': STRING_PUTC('\"'); break;
+                    case '\\': STRING_PUTC('\\'); break;
+                    case '/':  STRING_PUTC('/');  break;
+                    case 'b':  STRING_PUTC('\b'); break;
+                    case 'f':  STRING_PUTC('\f'); break;
+                    case 'n':  STRING_PUTC('\n'); break;
+                    case 'r':  STRING_PUTC('\r'); break;
+                    case 't':  STRING_PUTC('\t'); break;
                     case 'u': {
                         unsigned u;
-                        if (!(p = json_parse_hex4(p, &u))) {
-                            STRING_ERROR(JSON_PARSE_INVALID_UNICODE_HEX);
+                        if (!(p = json_parse_hex4(p, c->end, &u))) {
+                            STRING_ERROR(JSON_PARSE_INVALID_UNICODE_HEX, escape);
                         }                       
                         if (u >= 0xd800 && u <= 0xdbff) {
-                            if (*p ++ != '\\' || *p ++ != 'u') {
-                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_SURROGATE);
+                            if (c->end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_SURROGATE, escape);
                             }
+                            p += 2;
                             unsigned lowu;
-                            if (!(p = json_parse_hex4(p, &lowu))) {                              
-                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_HEX);
+                            if (!(p = json_parse_hex4(p, c->end, &lowu))) {                              
+                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_HEX, escape);
                             }
                             if (!(lowu >= 0xdc00 && lowu <= 0xdfff)) {                                
-                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_SURROGATE);
+                                STRING_ERROR(JSON_PARSE_INVALID_UNICODE_SURROGATE, escape);
                             }
                             u = 0x10000 + (u - 0xd800) * 0x400 + (lowu - 0xdc00);
                         }
-                        json_encode_utf8(c, u);
+                        if (w != NULL) {
+                            w = json_encode_utf8(w, u);
+                        } else {
+                            char* q = json_context_push(c, 4);
+                            c->top -= 4 - (json_encode_utf8(q, u) - q);
+                        }
                         break;
                     }
-                    default: STRING_ERROR(JSON_PARSE_INVALID_STRING_ESCAPE);
+                    default: STRING_ERROR(JSON_PARSE_INVALID_STRING_ESCAPE, escape);
                 }
                 break;
             }
             default: { 
                 if ((unsigned char)ch < 0x20) {
-                    STRING_ERROR(JSON_PARSE_INVALID_STRING_CHAR);
+                    STRING_ERROR(JSON_PARSE_INVALID_STRING_CHAR, p - 1);
                 }
-                PUTC(c, ch);
+                STRING_PUTC(ch);
             }
         }
     }
 }
+// 把解码后的字符串s放进v
+static void json_context_set_string(json_context* c, json_value* v, const char* s, size_t len) {
+    if (c->insitu) { // 已经解码在可写的输入缓冲区中，直接指向它
+        v->u.s.s = (char*)s;
+        v->u.s.len = len;
+        v->type = JSON_STRING;
+        v->flags = JSON_FLAG_BORROWED;
+    } else if (c->arena != NULL) {
+        v->u.s.s = json_context_strdup(c, s, len);
+        v->u.s.len = len;
+        v->type = JSON_STRING;
+        v->flags = JSON_FLAG_BORROWED;
+    } else {
+        json_set_string(v, s, len);
+    }
+}
 static int json_parse_string(json_context* c, json_value* v) {
     char* s;
     size_t len;
     int ret = json_parse_string_raw(c, &s, &len);
     if (ret == JSON_PARSE_OK) {
-        json_set_string(v, s, len);
+        if (c->sax != NULL) { // s指向解析栈，在下一次压栈之前有效
+            return SAX_CALL(c, string, (c->ud, s, len)) ? JSON_PARSE_OK : JSON_PARSE_STOPPED;
+        }
+        json_context_set_string(c, v, s, len);
     }
     return ret;
 }
-static int json_parse_value(json_context* c, json_value* v);
-static int json_parse_array(json_context* c, json_value* v) {
-    EXPECT(c, '[');
-    json_parse_whitespace(c);
-    if (*c->json == ']') {
-        c->json ++;
-        json_set_array(v, 0);
-        return JSON_PARSE_OK;
+static void json_context_set_array(json_context* c, json_value* v, size_t capacity) {
+    if (c->arena == NULL) {
+        json_set_array(v, capacity);
+        return;
     }
-    int ret;
-    size_t size = 0;
+    v->type = JSON_ARRAY;
+    v->flags = JSON_FLAG_BORROWED;
+    v->u.a.size = 0;
+    v->u.a.capacity = capacity;
+    v->u.a.e = capacity > 0 ? (json_value*)json_arena_alloc(c->arena, capacity * sizeof(json_value)) : NULL;
+}
+static void json_context_set_object(json_context* c, json_value* v, size_t capacity) {
+    // 解析时对象大小已知，需要索引的话和成员数组一起分配，填充成员之后再建立索引
+    int indexed = capacity >= JSON_OBJECT_INDEX_THRESHOLD;
+    size_t bytes = json_object_bytes(capacity, indexed);
+    json_free(v);
+    v->type = JSON_OBJECT;
+    v->u.o.size = 0;
+    v->u.o.capacity = capacity;
+    if (c->arena == NULL) {
+        v->flags = c->insitu || c->pool != NULL ? JSON_FLAG_BORROWED_KEYS : 0;
+        v->u.o.m = capacity > 0 ? (json_member*)JSON_MALLOC(bytes) : NULL;
+    } else {
+        v->flags = JSON_FLAG_BORROWED | JSON_FLAG_BORROWED_KEYS;
+        v->u.o.m = capacity > 0 ? (json_member*)json_arena_alloc(c->arena, bytes) : NULL;
+    }
+    if (indexed) {
+        v->flags |= JSON_FLAG_INDEXED;
+    }
+}
+static int json_parse_value(json_context* c, json_value* v);
+// 跳过字符串，只检查它有闭引号、没有控制字符，不检查转义序列
+static int json_skip_string(const char** pp, const char* end) {
+    const char* p = *pp;
     for (;;) {
-        json_value e;
-        json_init(&e);
-        ret = json_parse_value(c, &e);
-        if (ret != JSON_PARSE_OK) {
-            break;
+        p = json_scan_string(p, end);
+        if (p == end) {
+            return JSON_PARSE_MISS_QUOTATION_MARK;
         }
-        memcpy(json_context_push(c, sizeof(json_value)), &e, sizeof(json_value));
-        size ++;
-        json_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json ++;
-            json_parse_whitespace(c);
-        } else if (*c->json == ']') {
-            c->json ++;
-            json_set_array(v, size);
-            memcpy(v->u.a.e, json_context_pop(c, size * sizeof(json_value)), size * sizeof(json_value));
-            v->u.a.size = size;
+        char ch = *p ++;
+        if (ch == '\"') {
+            *pp = p;
             return JSON_PARSE_OK;
+        } else if (ch == '\\') {
+            if (p == end) {
+                return JSON_PARSE_MISS_QUOTATION_MARK;
+            }
+            p ++;
         } else {
-            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-            break;
+            return JSON_PARSE_INVALID_STRING_CHAR;
         }
     }
-    for (int i = 0; i < size; i ++) {
-        json_free((json_value*)json_context_pop(c, sizeof(json_value)));
-    }
-    return ret;
 }
-static int json_parse_object(json_context* c, json_value* v) {
-    EXPECT(c, '{');
-    json_parse_whitespace(c);
-    if (*c->json == '}') {
-        c->json ++;
-        json_set_object(v, 0);
-        return JSON_PARSE_OK;
+/* 跳过一个值而不建立它：标量完整检查，数组和对象只检查括号配对、字符串闭合，
+   其中的逗号、冒号、标量不检查。未闭合的括号记在解析栈上 */
+static int json_skip(json_context* c) {
+    if (c->json == c->end) {
+        return JSON_PARSE_EXPECT_VALUE;
     }
+    char ch = *c->json;
+    if (ch != '\"' && ch != '[' && ch != '{') {
+        json_value v;
+        json_init(&v);
+        return json_parse_value(c, &v); // 标量不会分配内存
+    }
+    const char* p = c->json + 1;
     int ret;
-    size_t size = 0;
-    json_member m;
-    m.k = NULL;
-    for (;;) {
-        json_init(&m.v);
-        char* str;
-        if (*c->json != '\"') {
-            ret = JSON_PARSE_MISS_KEY;
-            break;
-        }
-        ret = json_parse_string_raw(c, &str, &m.klen);
-        if (ret != JSON_PARSE_OK) {
-            break;
-        }
-        memcpy(m.k = (char*)malloc(m.klen + 1), str, m.klen);
-        m.k[m.klen] = '\0';
-        json_parse_whitespace(c);
-        if (*c->json != ':') {
-            ret = JSON_PARSE_MISS_COLON;
-            break;
+    if (ch == '\"') {
+        ret = json_skip_string(&p, c->end);
+        if (ret == JSON_PARSE_OK) {
+            c->json = p;
         }
-        c->json ++;
-        json_parse_whitespace(c);
-        ret = json_parse_value(c, &m.v);
-        if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    if (c->depth >= c->max_depth) {
+        return JSON_PARSE_TOO_DEEP;
+    }
+    size_t head = c->top;
+    PUTC(c, ch);
+    for (;;) {
+        p = json_scan_structure(p, c->end);
+        if (p == c->end) {
+            ch = c->stack[c->top - 1];
+            ret = ch == '[' ? JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
             break;
         }
-        size ++;
-        memcpy(json_context_push(c, sizeof(json_member)), &m, sizeof(json_member));
-        m.k = NULL;
-
-        json_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json ++;
-            json_parse_whitespace(c);
-        } else if (*c->json == '}') {
-            c->json ++;
-            json_set_object(v, size);
-            memcpy(v->u.o.m, json_context_pop(c, size * sizeof(json_member)), size * sizeof(json_member));
-            v->u.o.size = size;
-            return JSON_PARSE_OK;
+        ch = *p ++;
+        if (ch == '\"') {
+            if ((ret = json_skip_string(&p, c->end)) != JSON_PARSE_OK) {
+                break;
+            }
+        } else if (ch == '[' || ch == '{') {
+            if (c->depth + (c->top - head) >= c->max_depth) {
+                c->json = p - 1;
+                c->top = head;
+                return JSON_PARSE_TOO_DEEP;
+            }
+            PUTC(c, ch);
         } else {
-            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-            break;
+            char open = c->stack[c->top - 1];
+            if ((open == '[') != (ch == ']')) {
+                ret = open == '[' ? JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                break;
+            }
+            if (-- c->top == head) {
+                c->json = p;
+                return JSON_PARSE_OK;
+            }
         }
     }
-    free(m.k);
-    for (int i = 0; i < size; i ++) {
-        json_member* m = (json_member*)json_context_pop(c, sizeof(json_member));
-        free(m->k);
-        json_free(&m->v);
-    }
-    v->type = JSON_NULL;
+    c->top = head;
     return ret;
 }
-static int json_parse_value(json_context* c, json_value* v) {
-    switch (*c->json) {
-        case 'n': return json_parse_literal(c, v, "null", JSON_NULL);
-        case 't': return json_parse_literal(c, v, "true", JSON_TRUE);
-        case 'f': return json_parse_literal(c, v, "false", JSON_FALSE);
-        case '\0': return JSON_PARSE_EXPECT_VALUE;
-        case '\"': return json_parse_string(c, v);
-        case '[': return json_parse_array(c, v);
-        case '{': return json_parse_object(c, v);
-        default: return json_parse_number(c, v);
-    }
-}
-int json_parse(json_value* v, const char* json) {
-    assert(v != NULL);
-    json_context c;
-    c.json = json;
-    c.stack = NULL;
-    c.size = c.top = 0;
-    json_init(v);
+/* 只检查语法、不建立值：字符串不解码，数字只在可能溢出时才转换，出错的位置和错误码与json_parse_value相同。
+   未闭合的括号记在解析栈上 */
+static int json_validate_string(json_context* c) {
+    const char* p = c->json + 1;
+    for (;;) {
+        p = json_scan_string(p, c->end);
+        if (p == c->end) {
+            c->json = p;
+            return JSON_PARSE_MISS_QUOTATION_MARK;
+        }
+        char ch = *p ++;
+        if (ch == '\"') {
+            c->json = p;
+            return JSON_PARSE_OK;
+        } else if (ch == '\\') {
+            const char* escape = p - 1;
+            char esc = PEEK(c, p);
+            p ++;
+            switch (esc) {
+                case '\"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't': break;
+                case 'u': {
+                    unsigned u;
+                    c->json = escape;
+                    if (!(p = json_parse_hex4(p, c->end, &u))) {
+                        return JSON_PARSE_INVALID_UNICODE_HEX;
+                    }
+                    if (u >= 0xd800 && u <= 0xdbff) {
+                        if (c->end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+                            return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+                        }
+                        if (!(p = json_parse_hex4(p + 2, c->end, &u))) {
+                            return JSON_PARSE_INVALID_UNICODE_HEX;
+                        }
+                        if (!(u >= 0xdc00 && u <= 0xdfff)) {
+                            return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+                        }
+                    }
+                    break;
+                }
+                default: c->json = escape; return JSON_PARSE_INVALID_STRING_ESCAPE;
+            }
+        } else if ((unsigned char)ch < 0x20) {
+            c->json = p - 1;
+            return JSON_PARSE_INVALID_STRING_CHAR;
+        }
+    }
+}
+static int json_validate_number(json_context* c) {
+    const char* p = c->json;
+    size_t digits = 1; // 整数部分的位数
+    int e = 0;
+    if (PEEK(c, p) == '-') {
+        p ++;
+    }
+    if (PEEK(c, p) == '0') {
+        p ++;
+    } else {
+        if (!ISDIGIT_1TO9(PEEK(c, p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        const char* q = p;
+        while (ISDIGIT(PEEK(c, p))) {
+            p ++;
+        }
+        digits = p - q;
+    }
+    if (PEEK(c, p) == '.') {
+        p ++;
+        if (!ISDIGIT(PEEK(c, p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        while (ISDIGIT(PEEK(c, p))) {
+            p ++;
+        }
+    }
+    if (PEEK(c, p) == 'e' || PEEK(c, p) == 'E') {
+        int eneg = 0;
+        p ++;
+        if (PEEK(c, p) == '+' || PEEK(c, p) == '-') {
+            eneg = *p == '-';
+            p ++;
+        }
+        if (!ISDIGIT(PEEK(c, p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        for (; ISDIGIT(PEEK(c, p)); p ++) {
+            if (e < 100000) {
+                e = e * 10 + (*p - '0');
+            }
+        }
+        e = eneg ? -e : e;
+    }
+    if ((long)digits + e > 308) { // 绝对值可能达到10^308以上，按解析时同样的方式转换检查是否溢出
+        json_value t;
+        json_init(&t);
+        return json_parse_number(c, &t);
+    }
+    c->json = p;
+    return JSON_PARSE_OK;
+}
+static int json_validate_scalar(json_context* c) {
+    json_value t;
+    if (c->json == c->end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    switch (*c->json) {
+        case 'n': return json_parse_literal(c, &t, "null", JSON_NULL);
+        case 't': return json_parse_literal(c, &t, "true", JSON_TRUE);
+        case 'f': return json_parse_literal(c, &t, "false", JSON_FALSE);
+        case '\"': return json_validate_string(c);
+        default: return json_validate_number(c);
+    }
+}
+// 对象成员的键和冒号
+static int json_validate_key(json_context* c) {
+    if (PEEK(c, c->json) != '\"') {
+        return JSON_PARSE_MISS_KEY;
+    }
+    int ret = json_validate_string(c);
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    json_parse_whitespace(c);
+    if (PEEK(c, c->json) != ':') {
+        return JSON_PARSE_MISS_COLON;
+    }
+    c->json ++;
+    json_parse_whitespace(c);
+    return JSON_PARSE_OK;
+}
+static int json_validate(json_context* c) {
+    size_t head = c->top;
+    int ret = JSON_PARSE_OK;
+    for (;;) {
+        char ch = PEEK(c, c->json);
+        if (ch == '[' || ch == '{') {
+            if (c->depth + (c->top - head) >= c->max_depth) {
+                ret = JSON_PARSE_TOO_DEEP;
+                break;
+            }
+            PUTC(c, ch);
+            c->json ++;
+            json_parse_whitespace(c);
+            if (PEEK(c, c->json) != ch + 2) { // ']'和'}'分别是'['和'{'加2
+                if (ch == '{' && (ret = json_validate_key(c)) != JSON_PARSE_OK) {
+                    break;
+                }
+                continue;
+            }
+            c->json ++;
+            c->top --;
+        } else if ((ret = json_validate_scalar(c)) != JSON_PARSE_OK) {
+            break;
+        }
+        // 一个值结束，读','或结束括号；结束括号又使外层容器得到一个完整的值
+        while (c->top > head) {
+            char open = c->stack[c->top - 1];
+            json_parse_whitespace(c);
+            ch = PEEK(c, c->json);
+            if (ch == ',') {
+                c->json ++;
+                json_parse_whitespace(c);
+                if (open == '{') {
+                    ret = json_validate_key(c);
+                }
+                break;
+            }
+            if (ch != open + 2) {
+                ret = open == '[' ? JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                break;
+            }
+            c->json ++;
+            c->top --;
+        }
+        if (ret != JSON_PARSE_OK || c->top == head) {
+            break;
+        }
+    }
+    c->top = head;
+    return ret;
+}
+// 对象成员的键是否在c->keys中
+static int json_key_wanted(const json_context* c, const char* k, size_t klen) {
+    for (const char* const* w = c->keys; *w != NULL; w ++) {
+        if (strlen(*w) == klen && memcmp(*w, k, klen) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+/* 数组和对象用显式栈解析，嵌套深度不受线程栈大小的限制。每个未完成的容器在解析栈上有一个frame，
+   它已经解析的元素(json_value)或成员(json_member)依次压在frame之上；成员在读到键时就压栈，值解析完再填进去 */
+typedef struct {
+    size_t parent; // 外层容器的frame在解析栈中的位置
+    size_t size;   // 数组为已完成的元素个数，对象为已读到的键的个数
+    int object;
+} json_parse_frame;
+#define PARSE_FRAME(c, frame) ((json_parse_frame*)((c)->stack + (frame)))
+// c->json指向'['或'{'，开始一个新的容器，*frame变为它的frame；之后的空白由调用者跳过
+static int json_parse_open(json_context* c, size_t* frame) {
+    int object = *c->json == '{';
+    if (c->depth >= c->max_depth) {
+        return JSON_PARSE_TOO_DEEP;
+    }
+    c->json ++;
+    if (c->sax != NULL && !(object ? SAX_CALL(c, start_object, (c->ud)) : SAX_CALL(c, start_array, (c->ud)))) {
+        return JSON_PARSE_STOPPED;
+    }
+    json_parse_frame* f = (json_parse_frame*)json_context_push(c, sizeof(json_parse_frame));
+    f->parent = *frame;
+    f->size = 0;
+    f->object = object;
+    *frame = c->top - sizeof(json_parse_frame);
+    c->depth ++;
+    return JSON_PARSE_OK;
+}
+// 结束当前的容器，它的元素或成员出栈组成e，*frame回到外层容器
+static int json_parse_close(json_context* c, size_t* frame, json_value* e) {
+    json_parse_frame f = *PARSE_FRAME(c, *frame);
+    c->depth --;
+    if (c->sax != NULL) {
+        c->top = *frame;
+        *frame = f.parent;
+        return (f.object ? SAX_CALL(c, end_object, (c->ud, f.size)) : SAX_CALL(c, end_array, (c->ud, f.size))) ? JSON_PARSE_OK : JSON_PARSE_STOPPED;
+    }
+    if (f.object) {
+        json_context_set_object(c, e, f.size);
+        memcpy(e->u.o.m, json_context_pop(c, f.size * sizeof(json_member)), f.size * sizeof(json_member));
+        e->u.o.size = f.size;
+        if (e->flags & JSON_FLAG_INDEXED) {
+            json_object_rebuild_index(e);
+        }
+    } else {
+        json_context_set_array(c, e, f.size);
+        memcpy(e->u.a.e, json_context_pop(c, f.size * sizeof(json_value)), f.size * sizeof(json_value));
+        e->u.a.size = f.size;
+    }
+    json_context_pop(c, sizeof(json_parse_frame));
+    *frame = f.parent;
+    return JSON_PARSE_OK;
+}
+// 对象成员压栈，值解析完再填进去
+static void json_parse_push_member(json_context* c, const char* str, size_t klen) {
+    json_member m;
+    if (c->pool != NULL) {
+        m.k = (char*)json_key_pool_intern(c->pool, str, klen);
+    } else {
+        m.k = c->insitu ? (char*)str : json_context_strdup(c, str, klen); // 原地解析时str在可写的输入缓冲区中
+    }
+    m.klen = klen;
+    json_init(&m.v);
+    memcpy(json_context_push(c, sizeof(json_member)), &m, sizeof(json_member));
+}
+// 读对象成员的键和冒号，c->keys中没有的键*skip为1，它的值直接跳过
+static int json_parse_key(json_context* c, size_t frame, int* skip) {
+    char* str;
+    size_t klen;
+    if (PEEK(c, c->json) != '\"') {
+        return JSON_PARSE_MISS_KEY;
+    }
+    int ret = json_parse_string_raw(c, &str, &klen);
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    *skip = 0;
+    if (c->sax != NULL) {
+        if (!SAX_CALL(c, key, (c->ud, str, klen))) {
+            return JSON_PARSE_STOPPED;
+        }
+    } else if (c->keys != NULL && !json_key_wanted(c, str, klen)) {
+        *skip = 1;
+    } else {
+        json_parse_push_member(c, str, klen);
+    }
+    if (!*skip) {
+        PARSE_FRAME(c, frame)->size ++;
+    }
+    json_parse_whitespace(c);
+    if (PEEK(c, c->json) != ':') {
+        return JSON_PARSE_MISS_COLON;
+    }
+    c->json ++;
+    json_parse_whitespace(c);
+    return JSON_PARSE_OK;
+}
+// 出错时释放所有未完成的容器中已经解析的内容
+static void json_parse_unwind(json_context* c, size_t frame, size_t depth) {
+    int owns_keys = c->arena == NULL && c->pool == NULL && !c->insitu;
+    while (c->depth > depth) {
+        json_parse_frame f = *PARSE_FRAME(c, frame);
+        char* p = c->stack + frame + sizeof(json_parse_frame);
+        for (size_t i = 0; c->sax == NULL && i < f.size; i ++) {
+            if (f.object) {
+                json_member* m = (json_member*)p + i;
+                if (owns_keys) {
+                    JSON_FREE(m->k);
+                }
+                json_free(&m->v);
+            } else {
+                json_free((json_value*)p + i);
+            }
+        }
+        c->top = frame;
+        frame = f.parent;
+        c->depth --;
+    }
+}
+// c->json指向'['或'{'
+static int json_parse_container(json_context* c, json_value* v) {
+    size_t depth = c->depth, frame = 0;
+    json_value e;
+    int ret = json_parse_open(c, &frame);
+    int opened = 1; // 刚读过'['或'{'，可以直接遇到结束括号
+    while (ret == JSON_PARSE_OK) {
+        int object = PARSE_FRAME(c, frame)->object, skip = 0;
+        json_init(&e);
+        if (opened) {
+            json_parse_whitespace(c);
+        }
+        if (opened && PEEK(c, c->json) == (object ? '}' : ']')) {
+            c->json ++;
+            ret = json_parse_close(c, &frame, &e);
+        } else {
+            if (object && (ret = json_parse_key(c, frame, &skip)) != JSON_PARSE_OK) {
+                break;
+            }
+            if (skip) {
+                ret = json_skip(c);
+            } else if (!c->lazy && (PEEK(c, c->json) == '[' || PEEK(c, c->json) == '{')) {
+                ret = json_parse_open(c, &frame);
+                opened = 1;
+                continue;
+            } else {
+                ret = json_parse_value(c, &e);
+            }
+        }
+        opened = 0;
+        // 得到了一个完整的值e(跳过的成员没有)，放进所在的容器，再读','或结束括号；结束括号又使外层容器得到一个完整的值
+        while (ret == JSON_PARSE_OK) {
+            if (c->depth == depth) {
+                memcpy(v, &e, sizeof(json_value));
+                return JSON_PARSE_OK;
+            }
+            object = PARSE_FRAME(c, frame)->object;
+            if (c->sax == NULL && !skip) {
+                if (object) {
+                    memcpy(&((json_member*)(c->stack + c->top) - 1)->v, &e, sizeof(json_value));
+                } else {
+                    memcpy(json_context_push(c, sizeof(json_value)), &e, sizeof(json_value));
+                }
+            }
+            if (!object) {
+                PARSE_FRAME(c, frame)->size ++;
+            }
+            skip = 0;
+            json_parse_whitespace(c);
+            char ch = PEEK(c, c->json);
+            if (ch == ',') {
+                c->json ++;
+                json_parse_whitespace(c);
+                break;
+            } else if (ch == (object ? '}' : ']')) {
+                c->json ++;
+                json_init(&e);
+                ret = json_parse_close(c, &frame, &e);
+            } else {
+                ret = object ? JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET : JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            }
+        }
+    }
+    json_parse_unwind(c, frame, depth);
+    return ret;
+}
+// 跳过一个已经验证过的数组、对象或字符串，只需要配对括号和找到字符串的结尾
+static const char* json_skip_validated(const char* p, const char* end) {
+    size_t depth = 0;
+    do {
+        char ch = *p ++;
+        if (ch == '\"') {
+            for (;;) {
+                p = json_scan_string(p, end);
+                ch = *p ++;
+                if (ch == '\"') {
+                    break;
+                }
+                if (ch == '\\') {
+                    p ++;
+                }
+            }
+        } else if (ch == '[' || ch == '{') {
+            depth ++;
+        } else if (ch == ']' || ch == '}') {
+            depth --;
+        }
+    } while (depth > 0);
+    return p;
+}
+/* 延迟的值的状态放在单独分配的单元中：访问函数的参数是const，第一次访问时解析的结果缓存在单元里，
+   值本身不会被改写；修改函数和json_free再把单元中的结果移回值本身 */
+typedef struct {
+    const char* json; // 这个值在输入中的原文
+    size_t len;
+    json_value v;     // 解析出的这一层，解析之前是null
+} json_lazy;
+#define JSON_LAZY(v) ((json_lazy*)(v)->u.s.s)
+static int json_parse_lazy_value(json_context* c, json_value* v) {
+    const char* p = c->json;
+    json_lazy* l = (json_lazy*)JSON_MALLOC(sizeof(json_lazy));
+    v->type = *p == '[' ? JSON_ARRAY : *p == '{' ? JSON_OBJECT : JSON_STRING;
+    v->flags = JSON_FLAG_LAZY;
+    c->json = json_skip_validated(p, c->end);
+    l->json = p;
+    l->len = c->json - p;
+    json_init(&l->v);
+    v->u.s.s = (char*)l;
+    v->u.s.len = 0;
+    return JSON_PARSE_OK;
+}
+static int json_sax_scalar(json_context* c, const json_value* v) {
+    int ok;
+    switch (v->type) {
+        case JSON_NULL: ok = SAX_CALL(c, null_value, (c->ud)); break;
+        case JSON_FALSE:
+        case JSON_TRUE: ok = SAX_CALL(c, boolean, (c->ud, v->type == JSON_TRUE)); break;
+        default: ok = SAX_CALL(c, number, (c->ud, v)); break;
+    }
+    return ok ? JSON_PARSE_OK : JSON_PARSE_STOPPED;
+}
+static int json_parse_value(json_context* c, json_value* v) {
+    if (c->json == c->end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    if (c->lazy && (*c->json == '[' || *c->json == '{' || *c->json == '\"')) {
+        return json_parse_lazy_value(c, v);
+    }
+    int ret;
+    switch (*c->json) {
+        case 'n': ret = json_parse_literal(c, v, "null", JSON_NULL); break;
+        case 't': ret = json_parse_literal(c, v, "true", JSON_TRUE); break;
+        case 'f': ret = json_parse_literal(c, v, "false", JSON_FALSE); break;
+        case '\"': return json_parse_string(c, v);
+        case '[':
+        case '{': return json_parse_container(c, v);
+        default: ret = json_parse_number(c, v); break;
+    }
+    // SAX模式下标量只是栈上的临时值，解析完直接交给回调
+    if (ret == JSON_PARSE_OK && c->sax != NULL) {
+        ret = json_sax_scalar(c, v);
+    }
+    return ret;
+}
+/* 两阶段解析的第二阶段：按结构索引建立树。容器的frame、键和值的建立都与json_parse_container共用，
+   只是下一个位置直接从索引中读，不再逐字节跳过空白；没有反斜杠和控制字符的字符串由开、闭引号的位置直接拷贝，
+   标量仍由json_parse_value解析，并检查它正好结束在空白或下一个索引处。
+   只接受合法的输入：发现任何错误都释放已经建立的部分并返回0，由调用者用递归下降从头解析，得到完全相同的错误码和位置 */
+#define JSON_INDEX_TAPE(c) ((const uint32_t*)(c)->stack) // 索引放在解析栈的最底部，frame都在它之上
+// 下一个索引指向的位置，当前窗口读完时为下一个窗口建立索引；没有了返回NULL
+static const char* json_index_peek(json_context* c, json_index* ix) {
+    while (ix->pos == ix->count) {
+        if (ix->next == ix->end) {
+            return NULL;
+        }
+        json_index_window(ix, (uint32_t*)c->stack);
+    }
+    return ix->base + JSON_INDEX_TAPE(c)[ix->pos];
+}
+static const char* json_index_next(json_context* c, json_index* ix) {
+    const char* p = json_index_peek(c, ix);
+    ix->pos += p != NULL;
+    return p;
+}
+// p是字符串或标量的开头，解析到e中
+static int json_index_scalar(json_context* c, json_index* ix, const char* p, json_value* e) {
+    if (*p == '\"') { // 开引号之后的索引一定是闭引号
+        const char* q = json_index_next(c, ix);
+        if (q == NULL) {
+            return 0;
+        }
+        if (json_scan_string(p + 1, q) == q) { // 没有反斜杠和控制字符
+            json_context_set_string(c, e, p + 1, q - p - 1);
+            return 1;
+        }
+        c->json = p;
+        return json_parse_string(c, e) == JSON_PARSE_OK && c->json == q + 1;
+    }
+    if (*p == ']' || *p == '}' || *p == ',' || *p == ':') {
+        return 0;
+    }
+    c->json = p;
+    if (json_parse_value(c, e) != JSON_PARSE_OK) {
+        return 0;
+    }
+    p = c->json;
+    return p == c->end || p == json_index_peek(c, ix) || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r';
+}
+// p是成员的键的开引号，键压栈之后返回冒号之后的值的开头；不符合语法时返回NULL
+static const char* json_index_key(json_context* c, json_index* ix, size_t frame, const char* p) {
+    const char* q;
+    if (*p != '\"' || (q = json_index_next(c, ix)) == NULL) {
+        return NULL;
+    }
+    if (json_scan_string(p + 1, q) == q) {
+        json_parse_push_member(c, p + 1, q - p - 1);
+    } else {
+        char* str;
+        size_t klen;
+        c->json = p;
+        if (json_parse_string_raw(c, &str, &klen) != JSON_PARSE_OK || c->json != q + 1) {
+            return NULL;
+        }
+        json_parse_push_member(c, str, klen);
+    }
+    PARSE_FRAME(c, frame)->size ++;
+    if ((p = json_index_next(c, ix)) == NULL || *p != ':') {
+        return NULL;
+    }
+    return json_index_next(c, ix);
+}
+static int json_index_parse(json_context* c, json_value* v) {
+    const char* json = c->json;
+    size_t n = (size_t)(c->end - json) < JSON_INDEX_WINDOW ? (size_t)(c->end - json) : JSON_INDEX_WINDOW;
+    size_t depth = c->depth, frame = 0;
+    json_index ix;
+    json_value e;
+    if (n == 0) {
+        return 0;
+    }
+    json_context_push(c, (n * sizeof(uint32_t) + 15) & ~(size_t)15); // 一个窗口最多每个字节一个索引
+    json_index_init(&ix, json, c->end);
+    json_init(&e);
+    const char* p = json_index_next(c, &ix);
+    int ok = p != NULL;
+    while (ok) {
+        // p是一个值的开头
+        if (*p == '[' || *p == '{') {
+            int object = *p == '{';
+            c->json = p;
+            ok = json_parse_open(c, &frame) == JSON_PARSE_OK && (p = json_index_next(c, &ix)) != NULL;
+            if (!ok || *p != (object ? '}' : ']')) {
+                ok = ok && (!object || (p = json_index_key(c, &ix, frame, p)) != NULL);
+                continue;
+            }
+            json_parse_close(c, &frame, &e);
+        } else {
+            ok = json_index_scalar(c, &ix, p, &e);
+        }
+        // 得到了一个完整的值e，放进所在的容器，再读','或结束括号；结束括号又使外层容器得到一个完整的值
+        while (ok) {
+            if (c->depth == depth) { // 根之后不能再有别的内容
+                if (json_index_peek(c, &ix) != NULL) {
+                    ok = 0;
+                    break;
+                }
+                memcpy(v, &e, sizeof(json_value));
+                c->top = 0;
+                return 1;
+            }
+            int object = PARSE_FRAME(c, frame)->object;
+            if (object) {
+                memcpy(&((json_member*)(c->stack + c->top) - 1)->v, &e, sizeof(json_value));
+            } else {
+                memcpy(json_context_push(c, sizeof(json_value)), &e, sizeof(json_value));
+                PARSE_FRAME(c, frame)->size ++;
+            }
+            json_init(&e);
+            if ((p = json_index_next(c, &ix)) == NULL) {
+                ok = 0;
+            } else if (*p == ',') {
+                ok = (p = json_index_next(c, &ix)) != NULL && (!object || (p = json_index_key(c, &ix, frame, p)) != NULL);
+                break;
+            } else if (*p == (object ? '}' : ']')) {
+                json_parse_close(c, &frame, &e);
+            } else {
+                ok = 0;
+            }
+        }
+    }
+    json_free(&e);
+    json_parse_unwind(c, frame, depth);
+    c->top = 0;
+    c->json = json;
+    return 0;
+}
+static int json_parse_root(json_context* c, json_value* v) {
+    json_init(v);
+    // 建立树的解析都可以使用索引；SAX、原地、延迟和只取部分键的解析仍用递归下降
+    if (json_parse_engine == JSON_ENGINE_INDEXED && c->sax == NULL && !c->insitu && !c->lazy && c->keys == NULL
+        && json_index_parse(c, v)) {
+        return JSON_PARSE_OK;
+    }
+    json_parse_whitespace(c);
+    int ret = json_parse_value(c, v);
+    if (ret == JSON_PARSE_OK) {
+        json_parse_whitespace(c);
+        if (c->json != c->end) {
+            json_free(v);
+            ret = JSON_PARSE_ROOT_NOT_SINGULAR;
+        }
+    }
+    assert(c->top == 0);
+    return ret;
+}
+int json_parse(json_value* v, const char* json) {
+    assert(v != NULL);
+    return json_parse_n(v, json, strlen(json));
+}
+int json_parse_n(json_value* v, const char* json, size_t len) {
+    json_parser p;
+    json_parser_init(&p);
+    int ret = json_parser_parse(&p, v, json, len, NULL);
+    json_parser_free(&p);
+    return ret;
+}
+/* 出错位置：解析时不做任何记录，出错之后从头扫描到出错的位置，数出行号并还原出错的值在文档中的路径。
+   出错位置之前的内容已经被解析过，只需要配对括号、跳过字符串、记录数组下标和对象的键 */
+static char* json_write_uint64(char* p, uint64_t u);
+typedef struct {
+    size_t index;    // 数组中当前元素的下标
+    const char* key; // 对象中当前成员的键的原文(不含引号)，还没有读到键时为NULL
+    size_t klen;
+    int object, colon;
+} json_error_frame;
+static void json_error_append(json_parse_error* err, size_t* n, const char* s, size_t len) {
+    if (*n + len >= sizeof(err->path)) { // 放不下时以"..."结尾
+        *n = sizeof(err->path) - 4;
+        memcpy(err->path + *n, "...", 4);
+        *n = sizeof(err->path); // 之后的内容都不再写入
+        return;
+    }
+    memcpy(err->path + *n, s, len);
+    *n += len;
+    err->path[*n] = '\0';
+}
+static int json_is_identifier(const char* k, size_t klen) {
+    if (klen == 0 || ISDIGIT(k[0])) {
+        return 0;
+    }
+    for (size_t i = 0; i < klen; i ++) {
+        char ch = k[i];
+        if (!(ISDIGIT(ch) || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_' || ch == '$')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+static void json_error_locate(const char* json, const char* stop, json_parse_error* err) {
+    err->offset = stop - json;
+    err->line = 1;
+    const char* line = json;
+    for (const char* p = json; (p = memchr(p, '\n', stop - p)) != NULL; line = ++ p) {
+        err->line ++;
+    }
+    err->column = stop - line + 1;
+
+    json_error_frame* f = NULL;
+    size_t depth = 0, capacity = 0;
+    for (const char* p = json; p < stop; p ++) {
+        switch (*p) {
+            case '\"': {
+                const char* start = ++ p;
+                while (p < stop && *p != '\"') {
+                    p += *p == '\\' ? 2 : 1;
+                }
+                if (p < stop && depth > 0 && f[depth - 1].object && !f[depth - 1].colon) {
+                    f[depth - 1].key = start;
+                    f[depth - 1].klen = p - start;
+                }
+                break;
+            }
+            case '[':
+            case '{': {
+                if (depth == capacity) {
+                    capacity = capacity == 0 ? 16 : capacity * 2;
+                    f = (json_error_frame*)JSON_REALLOC(f, capacity * sizeof(json_error_frame));
+                }
+                memset(&f[depth], 0, sizeof(json_error_frame));
+                f[depth ++].object = *p == '{';
+                break;
+            }
+            case ']':
+            case '}': depth -= depth > 0; break;
+            case ',': {
+                if (depth > 0 && f[depth - 1].object) {
+                    f[depth - 1].key = NULL;
+                    f[depth - 1].colon = 0;
+                } else if (depth > 0) {
+                    f[depth - 1].index ++;
+                }
+                break;
+            }
+            case ':': {
+                if (depth > 0) {
+                    f[depth - 1].colon = 1;
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    size_t n = 0;
+    json_error_append(err, &n, "$", 1);
+    for (size_t i = 0; i < depth; i ++) {
+        char buf[32];
+        if (!f[i].object) {
+            buf[0] = '[';
+            char* end = json_write_uint64(buf + 1, f[i].index);
+            *end ++ = ']';
+            json_error_append(err, &n, buf, end - buf);
+        } else if (f[i].key == NULL) {
+            break;
+        } else if (json_is_identifier(f[i].key, f[i].klen)) {
+            json_error_append(err, &n, ".", 1);
+            json_error_append(err, &n, f[i].key, f[i].klen);
+        } else { // 键的原文就是合法的JSON字符串内容
+            json_error_append(err, &n, "[\"", 2);
+            json_error_append(err, &n, f[i].key, f[i].klen);
+            json_error_append(err, &n, "\"]", 2);
+        }
+    }
+    JSON_FREE(f);
+}
+int json_parse_ex(json_value* v, const char* json, size_t len, json_parse_error* err) {
+    json_parser p;
+    json_parser_init(&p);
+    int ret = json_parser_parse(&p, v, json, len, err);
+    json_parser_free(&p);
+    return ret;
+}
+void json_parser_init(json_parser* p) {
+    assert(p != NULL);
+    p->stack = NULL;
+    p->stack_size = 0;
+    p->scratch_allocator = json_global_allocator;
+}
+void json_parser_free(json_parser* p) {
+    assert(p != NULL);
+    json_alloc_free(&p->scratch_allocator, p->stack);
+    p->stack = NULL;
+    p->stack_size = 0;
+}
+int json_parser_parse(json_parser* p, json_value* v, const char* json, size_t len, json_parse_error* err) {
+    assert(p != NULL && v != NULL && (json != NULL || len == 0));
+    json_context c;
+    json_context_init(&c, json, len);
+    c.stack = p->stack; // 解析栈留在p中，下一次解析继续使用
+    c.size = p->stack_size;
+    c.alloc = &p->scratch_allocator;
+    int ret = json_parse_root(&c, v);
+    p->stack = c.stack;
+    p->stack_size = c.size;
+    if (ret != JSON_PARSE_OK && err != NULL) {
+        json_error_locate(json, c.json, err);
+    }
+    return ret;
+}
+int json_parse_insitu(json_value* v, char* buf) {
+    assert(v != NULL && buf != NULL);
+    json_context c;
+    json_context_init(&c, buf, strlen(buf));
+    c.insitu = 1;
+    int ret = json_parse_root(&c, v);
+    JSON_FREE(c.stack);
+    return ret;
+}
+int json_parse_arena(json_value* v, const char* json, json_arena* a) {
+    assert(v != NULL && a != NULL);
+    json_context c;
+    json_context_init(&c, json, strlen(json));
+    c.stack = a->stack; // 解析栈也留在arena中，reset之后继续复用
+    c.size = a->stack_size;
+    c.alloc = &a->allocator;
+    c.arena = a;
+    int ret = json_parse_root(&c, v);
+    a->stack = c.stack;
+    a->stack_size = c.size;
+    return ret;
+}
+int json_parse_intern(json_value* v, const char* json, json_key_pool* pool) {
+    assert(v != NULL && pool != NULL);
+    json_context c;
+    json_context_init(&c, json, strlen(json));
+    c.pool = pool;
+    int ret = json_parse_root(&c, v);
+    JSON_FREE(c.stack);
+    return ret;
+}
+int json_parse_keys(json_value* v, const char* json, size_t len, const char* const* keys) {
+    assert(v != NULL && keys != NULL && (json != NULL || len == 0));
+    json_context c;
+    json_context_init(&c, json, len);
+    c.keys = keys;
+    int ret = json_parse_root(&c, v);
+    JSON_FREE(c.stack);
+    return ret;
+}
+int json_skip_value(const char* json, size_t len, size_t* skipped) {
+    assert(json != NULL || len == 0);
+    json_context c;
+    json_context_init(&c, json, len);
+    json_parse_whitespace(&c);
+    int ret = json_skip(&c);
+    if (skipped != NULL) {
+        *skipped = ret == JSON_PARSE_OK ? (size_t)(c.json - json) : 0;
+    }
+    JSON_FREE(c.stack);
+    return ret;
+}
+int json_sax_parse(const char* json, size_t len, const json_sax_handler* h, void* ud) {
+    assert(h != NULL && (json != NULL || len == 0));
+    json_context c;
+    json_value v; // 只用来接收标量，不会持有内存
+    json_context_init(&c, json, len);
+    c.sax = h;
+    c.ud = ud;
+    int ret = json_parse_root(&c, &v);
+    JSON_FREE(c.stack);
+    return ret;
+}
+int json_parse_lazy(json_value* v, const char* json, size_t len) {
+    assert(v != NULL && (json != NULL || len == 0));
+    json_context c;
+    json_context_init(&c, json, len);
     json_parse_whitespace(&c);
-    int ret = json_parse_value(&c, v);
+    int ret = json_validate(&c);
     if (ret == JSON_PARSE_OK) {
         json_parse_whitespace(&c);
-        if (*c.json != '\0') {
-            v->type = JSON_NULL;
-            return JSON_PARSE_ROOT_NOT_SINGULAR;
+        if (c.json != c.end) {
+            ret = JSON_PARSE_ROOT_NOT_SINGULAR;
+        }
+    }
+    JSON_FREE(c.stack);
+    json_init(v);
+    if (ret == JSON_PARSE_OK) { // 输入已经验证过，之后的解析不会出错
+        json_context_init(&c, json, len);
+        c.lazy = 1;
+        json_parse_whitespace(&c);
+        ret = json_parse_value(&c, v);
+        JSON_FREE(c.stack);
+    }
+    return ret;
+}
+// 返回延迟的值解析出的一层，第一次调用时解析并缓存在单元中，其中的数组、对象、字符串仍然延迟
+static const json_value* json_resolve(const json_value* v) {
+    json_lazy* l = JSON_LAZY(v);
+    if (l->v.type == JSON_NULL) {
+        json_context c;
+        json_context_init(&c, l->json, l->len);
+        c.lazy = 1;
+        int ret;
+        switch (v->type) {
+            case JSON_STRING: ret = json_parse_string(&c, &l->v); break;
+            default: ret = json_parse_container(&c, &l->v); break;
+        }
+        assert(ret == JSON_PARSE_OK);
+        (void)ret;
+        JSON_FREE(c.stack);
+    }
+    return &l->v;
+}
+// 把单元中的结果移回值本身并释放单元，没有解析过时v变为null
+static void json_unlazy(json_value* v) {
+    json_lazy* l = JSON_LAZY(v);
+    memcpy(v, &l->v, sizeof(json_value));
+    JSON_FREE(l);
+}
+// 只读访问：const的v换成单元中解析出的值
+#define RESOLVE(v) do { if ((v)->flags & JSON_FLAG_LAZY) (v) = json_resolve(v); } while(0)
+// 修改之前：在v本身上解析
+#define MATERIALIZE(v) do { if ((v)->flags & JSON_FLAG_LAZY) { json_resolve(v); json_unlazy(v); } } while(0)
+
+/* 流式解析：输入分块到达，容器的嵌套用frames记录，跨越块边界的字符串/数字token先拷贝到token缓冲区，
+   token完整之后仍交给json_parse_string_raw/json_parse_number解析，错误码与json_parse一致 */
+enum {
+    JSON_STREAM_VALUE,        // 期待一个值
+    JSON_STREAM_ARRAY_FIRST,  // '['之后，期待值或']'
+    JSON_STREAM_OBJECT_FIRST, // '{'之后，期待键或'}'
+    JSON_STREAM_KEY,          // ','之后，期待键
+    JSON_STREAM_COLON,        // 键之后，期待':'
+    JSON_STREAM_AFTER_VALUE,  // 值之后，期待','、']'、'}'或输入结束
+    JSON_STREAM_STRING,       // 字符串或键中
+    JSON_STREAM_NUMBER,       // 数字中
+    JSON_STREAM_LITERAL       // null/true/false中
+};
+
+typedef struct {
+    size_t size; // 数组为已完成的元素个数，对象为已读到的键的个数
+    int object;
+} json_stream_frame;
+
+struct json_stream {
+    json_context c; // 树模式下解析栈保存未完成容器的元素/成员，字符串反转义也使用它
+    json_value* v;
+    json_stream_frame* frames;
+    size_t depth, frames_capacity;
+    char* token;
+    size_t token_len, token_capacity;
+    const char* literal;
+    size_t literal_pos;
+    json_type literal_type;
+    int state, ret;
+    int key;  // 当前字符串是对象的键
+    int esc;  // 字符串中上一个字符是'\\'
+    int done; // json_stream_finish成功，结果已经交给v
+};
+
+static json_stream* json_stream_create(json_value* v, const json_sax_handler* h, void* ud) {
+    json_stream* s = (json_stream*)JSON_MALLOC(sizeof(json_stream));
+    json_context_init(&s->c, NULL, 0);
+    s->c.sax = h;
+    s->c.ud = ud;
+    s->v = v;
+    s->frames = NULL;
+    s->depth = s->frames_capacity = 0;
+    s->token = NULL;
+    s->token_len = s->token_capacity = 0;
+    s->state = JSON_STREAM_VALUE;
+    s->ret = JSON_PARSE_OK;
+    s->key = s->esc = s->done = 0;
+    return s;
+}
+json_stream* json_stream_new(json_value* v) {
+    assert(v != NULL);
+    json_init(v);
+    return json_stream_create(v, NULL, NULL);
+}
+json_stream* json_stream_new_sax(const json_sax_handler* h, void* ud) {
+    assert(h != NULL);
+    return json_stream_create(NULL, h, ud);
+}
+static void json_stream_unwind(json_stream* s) {
+    while (s->depth > 0) {
+        json_stream_frame* f = &s->frames[-- s->depth];
+        for (size_t i = 0; s->c.sax == NULL && i < f->size; i ++) {
+            if (f->object) {
+                json_member* m = (json_member*)json_context_pop(&s->c, sizeof(json_member));
+                JSON_FREE(m->k);
+                json_free(&m->v);
+            } else {
+                json_free((json_value*)json_context_pop(&s->c, sizeof(json_value)));
+            }
+        }
+    }
+    if (s->v != NULL && !s->done) {
+        json_free(s->v);
+    }
+}
+void json_stream_free(json_stream* s) {
+    if (s == NULL) {
+        return;
+    }
+    json_stream_unwind(s);
+    JSON_FREE(s->c.stack);
+    JSON_FREE(s->frames);
+    JSON_FREE(s->token);
+    JSON_FREE(s);
+}
+static void json_stream_buffer(json_stream* s, const char* p, const char* end) {
+    size_t len = end - p;
+    if (len == 0) {
+        return;
+    }
+    if (s->token_len + len > s->token_capacity) {
+        while (s->token_len + len > s->token_capacity) {
+            s->token_capacity = s->token_capacity == 0 ? JSON_PARSE_STACK_INIT_SIZE : s->token_capacity * 2;
+        }
+        s->token = (char*)JSON_REALLOC(s->token, s->token_capacity);
+    }
+    memcpy(s->token + s->token_len, p, len);
+    s->token_len += len;
+}
+// token完整了：没有跨块时直接在输入上解析，否则拼上最后一段之后在token缓冲区中解析
+static void json_stream_slice(json_stream* s, const char* start, const char* stop) {
+    if (s->token_len > 0) {
+        json_stream_buffer(s, start, stop);
+        s->c.json = s->token;
+        s->c.end = s->token + s->token_len;
+        s->token_len = 0;
+    } else {
+        s->c.json = start;
+        s->c.end = stop;
+    }
+}
+static int json_stream_misplaced(const json_stream* s) { // 值之后出现了不该出现的字符
+    if (s->depth == 0) {
+        return JSON_PARSE_ROOT_NOT_SINGULAR;
+    }
+    return s->frames[s->depth - 1].object ? JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET : JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+}
+// 一个完整的值：SAX模式下产生事件，树模式下放到所在容器中(v的内存转交出去)
+static int json_stream_value(json_stream* s, json_value* v) {
+    int ret = JSON_PARSE_OK;
+    if (s->c.sax != NULL) {
+        if (v->type != JSON_ARRAY && v->type != JSON_OBJECT) {
+            ret = json_sax_scalar(&s->c, v);
+        }
+    } else if (s->depth == 0) {
+        memcpy(s->v, v, sizeof(json_value));
+    } else if (s->frames[s->depth - 1].object) {
+        memcpy(&((json_member*)(s->c.stack + s->c.top) - 1)->v, v, sizeof(json_value));
+    } else {
+        memcpy(json_context_push(&s->c, sizeof(json_value)), v, sizeof(json_value));
+    }
+    if (s->depth > 0 && !s->frames[s->depth - 1].object) {
+        s->frames[s->depth - 1].size ++;
+    }
+    s->state = JSON_STREAM_AFTER_VALUE;
+    return ret;
+}
+static int json_stream_open(json_stream* s, int object) {
+    if (s->depth >= s->c.max_depth) {
+        return JSON_PARSE_TOO_DEEP;
+    }
+    if (s->depth == s->frames_capacity) {
+        s->frames_capacity = s->frames_capacity == 0 ? 16 : s->frames_capacity * 2;
+        s->frames = (json_stream_frame*)JSON_REALLOC(s->frames, s->frames_capacity * sizeof(json_stream_frame));
+    }
+    s->frames[s->depth].size = 0;
+    s->frames[s->depth].object = object;
+    s->depth ++;
+    s->state = object ? JSON_STREAM_OBJECT_FIRST : JSON_STREAM_ARRAY_FIRST;
+    if (s->c.sax != NULL && !(object ? SAX_CALL(&s->c, start_object, (s->c.ud)) : SAX_CALL(&s->c, start_array, (s->c.ud)))) {
+        return JSON_PARSE_STOPPED;
+    }
+    return JSON_PARSE_OK;
+}
+static int json_stream_close(json_stream* s) {
+    json_stream_frame f = s->frames[s->depth - 1];
+    json_value v;
+    json_init(&v);
+    if (s->c.sax != NULL) {
+        if (!(f.object ? SAX_CALL(&s->c, end_object, (s->c.ud, f.size)) : SAX_CALL(&s->c, end_array, (s->c.ud, f.size)))) {
+            s->depth --;
+            return JSON_PARSE_STOPPED;
+        }
+        v.type = f.object ? JSON_OBJECT : JSON_ARRAY; // 只用来告诉json_stream_value这不是标量
+    } else if (f.object) {
+        json_context_set_object(&s->c, &v, f.size);
+        memcpy(v.u.o.m, json_context_pop(&s->c, f.size * sizeof(json_member)), f.size * sizeof(json_member));
+        v.u.o.size = f.size;
+        if (v.flags & JSON_FLAG_INDEXED) {
+            json_object_rebuild_index(&v);
+        }
+    } else {
+        json_context_set_array(&s->c, &v, f.size);
+        memcpy(v.u.a.e, json_context_pop(&s->c, f.size * sizeof(json_value)), f.size * sizeof(json_value));
+        v.u.a.size = f.size;
+    }
+    s->depth --;
+    return json_stream_value(s, &v);
+}
+static int json_stream_string(json_stream* s, const char* start, const char* stop) {
+    char* str;
+    size_t len;
+    json_stream_slice(s, start, stop);
+    int ret = json_parse_string_raw(&s->c, &str, &len);
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    if (s->key) {
+        s->state = JSON_STREAM_COLON;
+        s->frames[s->depth - 1].size ++;
+        if (s->c.sax != NULL) {
+            return SAX_CALL(&s->c, key, (s->c.ud, str, len)) ? JSON_PARSE_OK : JSON_PARSE_STOPPED;
+        }
+        json_member m;
+        m.k = (char*)JSON_MALLOC(len + 1); // 先拷贝，压栈可能覆盖str
+        memcpy(m.k, str, len);
+        m.k[len] = '\0';
+        m.klen = len;
+        json_init(&m.v);
+        memcpy(json_context_push(&s->c, sizeof(json_member)), &m, sizeof(json_member));
+        return JSON_PARSE_OK;
+    }
+    json_value v;
+    json_init(&v);
+    if (s->c.sax != NULL) {
+        s->state = JSON_STREAM_AFTER_VALUE;
+        if (s->depth > 0) {
+            s->frames[s->depth - 1].size ++;
+        }
+        return SAX_CALL(&s->c, string, (s->c.ud, str, len)) ? JSON_PARSE_OK : JSON_PARSE_STOPPED;
+    }
+    json_set_string(&v, str, len);
+    return json_stream_value(s, &v);
+}
+static int json_stream_number(json_stream* s, const char* start, const char* stop) {
+    json_value v;
+    json_init(&v);
+    json_stream_slice(s, start, stop);
+    const char* end = s->c.end;
+    int ret = json_parse_number(&s->c, &v);
+    if (ret == JSON_PARSE_OK) {
+        ret = json_stream_value(s, &v);
+        if (ret == JSON_PARSE_OK && s->c.json != end) { // 例如"01"、"1-2"，数字之后的字符不合法
+            ret = json_stream_misplaced(s);
+        }
+    }
+    return ret;
+}
+static int json_stream_begin_value(json_stream* s, const char* p) {
+    switch (*p) {
+        case 'n': s->literal = "null";  s->literal_type = JSON_NULL;  break;
+        case 't': s->literal = "true";  s->literal_type = JSON_TRUE;  break;
+        case 'f': s->literal = "false"; s->literal_type = JSON_FALSE; break;
+        case '\"': s->key = 0; s->esc = 0; s->state = JSON_STREAM_STRING; return JSON_PARSE_OK;
+        case '[': return json_stream_open(s, 0);
+        case '{': return json_stream_open(s, 1);
+        default: {
+            if (*p != '-' && !ISDIGIT(*p)) {
+                return JSON_PARSE_INVALID_VALUE;
+            }
+            s->state = JSON_STREAM_NUMBER;
+            return JSON_PARSE_OK;
+        }
+    }
+    s->literal_pos = 1;
+    s->state = JSON_STREAM_LITERAL;
+    return JSON_PARSE_OK;
+}
+// 非token状态下的一个非空白字符
+static int json_stream_char(json_stream* s, const char* p) {
+    char ch = *p;
+    switch (s->state) {
+        case JSON_STREAM_ARRAY_FIRST:
+            if (ch == ']') {
+                return json_stream_close(s);
+            }
+            return json_stream_begin_value(s, p);
+        case JSON_STREAM_VALUE:
+            return json_stream_begin_value(s, p);
+        case JSON_STREAM_OBJECT_FIRST:
+            if (ch == '}') {
+                return json_stream_close(s);
+            }
+            /* fall through */
+        case JSON_STREAM_KEY:
+            if (ch != '\"') {
+                return JSON_PARSE_MISS_KEY;
+            }
+            s->key = 1;
+            s->esc = 0;
+            s->state = JSON_STREAM_STRING;
+            return JSON_PARSE_OK;
+        case JSON_STREAM_COLON:
+            if (ch != ':') {
+                return JSON_PARSE_MISS_COLON;
+            }
+            s->state = JSON_STREAM_VALUE;
+            return JSON_PARSE_OK;
+        default: {
+            assert(s->state == JSON_STREAM_AFTER_VALUE);
+            if (s->depth > 0 && ch == ',') {
+                s->state = s->frames[s->depth - 1].object ? JSON_STREAM_KEY : JSON_STREAM_VALUE;
+                return JSON_PARSE_OK;
+            }
+            if (s->depth > 0 && ch == (s->frames[s->depth - 1].object ? '}' : ']')) {
+                return json_stream_close(s);
+            }
+            return json_stream_misplaced(s);
+        }
+    }
+}
+static int json_stream_fail(json_stream* s, int ret) {
+    if (ret != JSON_PARSE_OK) {
+        json_stream_unwind(s);
+        s->token_len = 0;
+        s->ret = ret;
+    }
+    return ret;
+}
+int json_stream_feed(json_stream* s, const char* chunk, size_t len) {
+    assert(s != NULL && !s->done && (chunk != NULL || len == 0));
+    const char* p = chunk;
+    const char* end = chunk + len;
+    const char* start = chunk; // 未完成的token在本块中的起点
+    int ret = s->ret;
+    while (ret == JSON_PARSE_OK && p != end) {
+        switch (s->state) {
+            case JSON_STREAM_STRING: {
+                if (s->esc) { // 转义字符的第二个字节，可能在上一块中只读到了'\\'
+                    s->esc = 0;
+                    p ++;
+                    break;
+                }
+                p = json_scan_string(p, end);
+                if (p != end) {
+                    if (*p == '\\') {
+                        s->esc = 1;
+                        p ++;
+                    } else { // '\"'或者控制字符，字符串到此结束(后者由json_parse_string_raw报错)
+                        ret = json_stream_string(s, start, ++ p);
+                    }
+                }
+                break;
+            }
+            case JSON_STREAM_NUMBER: {
+                while (p != end && (ISDIGIT(*p) || *p == '+' || *p == '-' || *p == '.' || *p == 'e' || *p == 'E')) {
+                    p ++;
+                }
+                if (p != end) {
+                    ret = json_stream_number(s, start, p);
+                }
+                break;
+            }
+            case JSON_STREAM_LITERAL: {
+                if (*p != s->literal[s->literal_pos]) {
+                    ret = JSON_PARSE_INVALID_VALUE;
+                    break;
+                }
+                p ++;
+                if (s->literal[++ s->literal_pos] == '\0') {
+                    json_value v;
+                    json_init(&v);
+                    v.type = s->literal_type;
+                    ret = json_stream_value(s, &v);
+                }
+                break;
+            }
+            default: {
+                if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+                    p ++;
+                    break;
+                }
+                start = p;
+                ret = json_stream_char(s, p ++);
+            }
+        }
+    }
+    if (ret == JSON_PARSE_OK && (s->state == JSON_STREAM_STRING || s->state == JSON_STREAM_NUMBER)) {
+        json_stream_buffer(s, start, end);
+    }
+    return json_stream_fail(s, ret);
+}
+int json_stream_finish(json_stream* s) {
+    assert(s != NULL && !s->done);
+    int ret = s->ret;
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    switch (s->state) { // 输入结束时，未完成的token按照json_parse遇到结尾的方式处理
+        case JSON_STREAM_STRING: ret = json_stream_string(s, NULL, NULL); break;
+        case JSON_STREAM_NUMBER: ret = json_stream_number(s, NULL, NULL); break;
+        case JSON_STREAM_LITERAL: ret = JSON_PARSE_INVALID_VALUE; break;
+    }
+    if (ret == JSON_PARSE_OK) {
+        switch (s->state) {
+            case JSON_STREAM_VALUE:
+            case JSON_STREAM_ARRAY_FIRST: ret = JSON_PARSE_EXPECT_VALUE; break;
+            case JSON_STREAM_OBJECT_FIRST:
+            case JSON_STREAM_KEY: ret = JSON_PARSE_MISS_KEY; break;
+            case JSON_STREAM_COLON: ret = JSON_PARSE_MISS_COLON; break;
+            default: ret = s->depth == 0 ? JSON_PARSE_OK : json_stream_misplaced(s);
+        }
+    }
+    if (ret == JSON_PARSE_OK) {
+        s->done = 1;
+    }
+    return json_stream_fail(s, ret);
+}
+
+/* NDJSON：按'\n'切出记录，每批JSON_NDJSON_BATCH * 线程数条记录交给线程池并行解析，
+   整批解析完之后在调用者线程中按顺序回调，每个线程的解析栈在整个过程中复用 */
+typedef struct {
+    const char* json;
+    size_t len, line;
+} json_ndjson_record;
+
+typedef struct {
+    json_ndjson_record* records;
+    json_value* values;
+    int* rets;
+    size_t count, next, finished; // 本批的记录数、下一条待领取的记录、已解析完的记录数
+#ifdef JSON_HAS_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    unsigned generation; // 每开始一批加一，用来唤醒worker
+    int quit;
+#endif
+} json_ndjson_pool;
+
+// 每个线程一个json_parser，解析栈留给下一条记录
+static void json_ndjson_run(json_ndjson_pool* pool, json_parser* parser) {
+    for (;;) {
+#ifdef JSON_HAS_PTHREAD
+        pthread_mutex_lock(&pool->lock);
+#endif
+        size_t i = pool->next, n = pool->count - i < JSON_NDJSON_GRAIN ? pool->count - i : JSON_NDJSON_GRAIN;
+        pool->next += n;
+#ifdef JSON_HAS_PTHREAD
+        pthread_mutex_unlock(&pool->lock);
+#endif
+        if (n == 0) {
+            return;
+        }
+        for (size_t j = i; j < i + n; j ++) {
+            pool->rets[j] = json_parser_parse(parser, &pool->values[j], pool->records[j].json, pool->records[j].len, NULL);
+        }
+#ifdef JSON_HAS_PTHREAD
+        pthread_mutex_lock(&pool->lock);
+        if ((pool->finished += n) == pool->count) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+#else
+        pool->finished += n;
+#endif
+    }
+}
+#ifdef JSON_HAS_PTHREAD
+static void* json_ndjson_worker(void* arg) {
+    json_ndjson_pool* pool = (json_ndjson_pool*)arg;
+    json_parser parser;
+    json_parser_init(&parser);
+    unsigned generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && generation == pool->generation) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        json_ndjson_run(pool, &parser);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    json_parser_free(&parser);
+    return NULL;
+}
+#endif
+static int json_is_blank(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p ++;
+    }
+    return p == end;
+}
+int json_parse_ndjson(const char* json, size_t len, unsigned threads, json_ndjson_callback cb, void* ud) {
+    assert((json != NULL || len == 0) && cb != NULL);
+#ifdef JSON_HAS_PTHREAD
+    if (threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+    }
+#else
+    threads = 1;
+#endif
+    size_t batch = (size_t)JSON_NDJSON_BATCH * (threads == 0 ? 1 : threads);
+    json_ndjson_pool pool;
+    pool.records = (json_ndjson_record*)JSON_MALLOC(batch * sizeof(json_ndjson_record));
+    pool.values = (json_value*)JSON_MALLOC(batch * sizeof(json_value));
+    pool.rets = (int*)JSON_MALLOC(batch * sizeof(int));
+    pool.count = pool.next = pool.finished = 0;
+#ifdef JSON_HAS_PTHREAD
+    pthread_t* workers = NULL;
+    unsigned started = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.generation = 0;
+    pool.quit = 0;
+    if (threads > 1) { // 调用者线程也参与解析
+        workers = (pthread_t*)JSON_MALLOC((threads - 1) * sizeof(pthread_t));
+        while (started < threads - 1 && pthread_create(&workers[started], NULL, json_ndjson_worker, &pool) == 0) {
+            started ++;
+        }
+    }
+#endif
+    json_parser parser;
+    json_parser_init(&parser);
+    const char* p = json;
+    const char* end = json + len;
+    size_t line = 0;
+    int ret = JSON_PARSE_OK;
+    while (p != end && ret != JSON_PARSE_STOPPED) {
+        size_t count = 0; // worker可能还在查看上一批的count，先填好本批再一起更新
+        while (p != end && count < batch) {
+            const char* q = (const char*)memchr(p, '\n', end - p);
+            if (q == NULL) {
+                q = end;
+            }
+            line ++;
+            if (!json_is_blank(p, q)) { // 空行不算记录
+                json_ndjson_record* r = &pool.records[count ++];
+                r->json = p;
+                r->len = q - p;
+                r->line = line;
+            }
+            p = q != end ? q + 1 : q;
+        }
+#ifdef JSON_HAS_PTHREAD
+        pthread_mutex_lock(&pool.lock);
+        pool.count = count;
+        pool.next = pool.finished = 0;
+        pool.generation ++;
+        pthread_cond_broadcast(&pool.work);
+        pthread_mutex_unlock(&pool.lock);
+        json_ndjson_run(&pool, &parser);
+        pthread_mutex_lock(&pool.lock);
+        while (pool.finished < pool.count) {
+            pthread_cond_wait(&pool.done, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+#else
+        pool.count = count;
+        pool.next = pool.finished = 0;
+        json_ndjson_run(&pool, &parser);
+#endif
+        for (size_t i = 0; i < pool.count; i ++) {
+            if (ret != JSON_PARSE_STOPPED) {
+                if (pool.rets[i] != JSON_PARSE_OK && ret == JSON_PARSE_OK) {
+                    ret = pool.rets[i];
+                }
+                if (!cb(ud, pool.records[i].line, pool.rets[i], &pool.values[i])) {
+                    ret = JSON_PARSE_STOPPED;
+                }
+            }
+            json_free(&pool.values[i]);
+        }
+    }
+#ifdef JSON_HAS_PTHREAD
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < started; i ++) {
+        pthread_join(workers[i], NULL);
+    }
+    JSON_FREE(workers);
+    pthread_cond_destroy(&pool.done);
+    pthread_cond_destroy(&pool.work);
+    pthread_mutex_destroy(&pool.lock);
+#endif
+    json_parser_free(&parser);
+    JSON_FREE(pool.records);
+    JSON_FREE(pool.values);
+    JSON_FREE(pool.rets);
+    return ret;
+}
+
+/* 遍历值树用的显式栈，每层记录一个数组或对象和下一个要访问的子值，嵌套深度不受线程栈大小的限制。
+   前JSON_WALK_INLINE层放在调用者的栈上，更深时才分配内存 */
+#define JSON_WALK_INLINE 16
+typedef struct {
+    const json_value* v; // 正在遍历的数组或对象
+    json_value* w;       // json_copy中对应的目标，json_is_equal中对应的另一个值
+    size_t i;            // 下一个子值的下标
+    uint32_t* idx;       // 生成时按键排序后的成员顺序
+    size_t off;          // 平坦格式中这一层的块(写入时)或槽(拷贝、检查时)的偏移
+} json_walk_frame;
+typedef struct {
+    json_walk_frame* f;
+    size_t depth, capacity;
+    json_walk_frame frames[JSON_WALK_INLINE];
+} json_walk;
+
+static void json_walk_init(json_walk* w) {
+    w->f = w->frames;
+    w->depth = 0;
+    w->capacity = JSON_WALK_INLINE;
+}
+static json_walk_frame* json_walk_push(json_walk* w, const json_value* v, json_value* other) {
+    if (w->depth == w->capacity) {
+        w->capacity *= 2;
+        if (w->f == w->frames) {
+            w->f = (json_walk_frame*)JSON_MALLOC(w->capacity * sizeof(json_walk_frame));
+            memcpy(w->f, w->frames, sizeof(w->frames));
+        } else {
+            w->f = (json_walk_frame*)JSON_REALLOC(w->f, w->capacity * sizeof(json_walk_frame));
+        }
+    }
+    json_walk_frame* f = &w->f[w->depth ++];
+    f->v = v;
+    f->w = other;
+    f->i = 0;
+    f->idx = NULL;
+    f->off = 0;
+    return f;
+}
+static void json_walk_free(json_walk* w) {
+    if (w->f != w->frames) {
+        JSON_FREE(w->f);
+    }
+}
+// 数组的元素个数或对象的成员个数，其他类型为0
+static size_t json_walk_size(const json_value* v) {
+    return v->type == JSON_ARRAY ? v->u.a.size : v->type == JSON_OBJECT ? v->u.o.size : 0;
+}
+
+// 释放v自己的字符串、元素数组或成员数组(子值已经释放)，v变为null
+static void json_free_storage(json_value* v) {
+    // 借用的存储(arena等)不释放
+    if (!(v->flags & JSON_FLAG_BORROWED)) {
+        switch (v->type) {
+            case JSON_STRING: JSON_FREE(v->u.s.s); break;
+            case JSON_ARRAY: JSON_FREE(v->u.a.e); break;
+            case JSON_OBJECT: JSON_FREE(v->u.o.m); break;
+            default: break;
+        }
+    }
+    v->type = JSON_NULL;
+    v->flags = 0;
+}
+void json_free(json_value* v) {
+    assert(v != NULL);
+    json_walk w;
+    json_walk_init(&w);
+    for (;;) {
+        if (v->flags & JSON_FLAG_LAZY) { // 已经解析出的部分仍要释放
+            json_unlazy(v);
+        }
+        // 借用的存储中可能挂着自己分配的子值，所以容器总是先压栈，子值都释放之后再释放它自己
+        if (json_walk_size(v) > 0) {
+            json_walk_push(&w, v, NULL);
+        } else {
+            json_free_storage(v);
+        }
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            json_value* p = (json_value*)f->v;
+            if (f->i == json_walk_size(p)) {
+                json_free_storage(p);
+                w.depth --;
+            } else if (p->type == JSON_ARRAY) {
+                v = &p->u.a.e[f->i ++];
+            } else {
+                json_member* m = &p->u.o.m[f->i ++];
+                if (!(p->flags & JSON_FLAG_BORROWED_KEYS)) {
+                    JSON_FREE(m->k);
+                }
+                v = &m->v;
+            }
+        }
+        if (v == NULL) {
+            break;
+        }
+    }
+    json_walk_free(&w);
+}
+
+
+
+typedef int (*json_member_less_fn)(const json_member* a, const json_member* b);
+// 稳定的归并排序，对成员下标排序而不移动成员
+static void json_sort_members(uint32_t* idx, uint32_t* tmp, size_t n, const json_member* m, json_member_less_fn less) {
+    if (n < 2) {
+        return;
+    }
+    size_t half = n / 2, i = 0, j = half, k = 0;
+    json_sort_members(idx, tmp, half, m, less);
+    json_sort_members(idx + half, tmp, n - half, m, less);
+    while (i < half && j < n) {
+        tmp[k ++] = less(&m[idx[j]], &m[idx[i]]) ? idx[j ++] : idx[i ++];
+    }
+    while (i < half) {
+        tmp[k ++] = idx[i ++];
+    }
+    memcpy(idx, tmp, k * sizeof(uint32_t)); // idx[j..n)已经在正确的位置
+}
+/* RFC 8785按UTF-16编码单元排序。UTF-8按字节比较等于按码点比较，只有第一个不同的字节是首字节、
+   一边是4字节序列(U+10000以上，UTF-16中是0xD800~0xDBFF的代理项)另一边是0xEE/0xEF(U+E000~U+FFFF)时顺序相反 */
+static int json_utf16_key_less(const json_member* a, const json_member* b) {
+    size_t n = a->klen < b->klen ? a->klen : b->klen, i = 0;
+    while (i < n && a->k[i] == b->k[i]) {
+        i ++;
+    }
+    if (i == n) {
+        return a->klen < b->klen;
+    }
+    unsigned x = (unsigned char)a->k[i], y = (unsigned char)b->k[i];
+    x = x >= 0xf0 ? 0xed * 2 + 1 : x * 2; // 4字节序列排在0xED(U+D000~U+D7FF)和0xEE之间
+    y = y >= 0xf0 ? 0xed * 2 + 1 : y * 2;
+    return x < y;
+}
+// 解码p处的一个非ASCII字符，不合法的UTF-8解码为U+FFFD并且只跳过一个字节
+static const char* json_decode_non_ascii(const char* p, const char* end, unsigned* cp_out) {
+    const unsigned char* q = (const unsigned char*)p;
+    unsigned u = 0xfffd, ch = *q ++;
+    int n = ch >= 0xf0 && ch <= 0xf4 ? 3 : ch >= 0xe0 ? (ch < 0xf0 ? 2 : -1) : ch >= 0xc2 ? 1 : -1;
+    if (n > 0 && end - (const char*)q >= n) {
+        unsigned cp = ch & (0x3f >> n);
+        int i;
+        for (i = 0; i < n && (q[i] & 0xc0) == 0x80; i ++) {
+            cp = cp << 6 | (q[i] & 0x3f);
+        }
+        static const unsigned min[] = { 0, 0x80, 0x800, 0x10000 };
+        if (i == n && cp >= min[n] && cp <= 0x10ffff && !(cp >= 0xd800 && cp <= 0xdfff)) {
+            u = cp;
+            q += n;
+        }
+    }
+    *cp_out = u;
+    return (const char*)q;
+}
+// 把非ASCII字符写成\uXXXX，U+10000以上写成代理对，不合法的UTF-8写成U+FFFD
+static const char* json_stringify_non_ascii(json_context* c, const char* p, const char* end, const char* hex_digits) {
+    unsigned u;
+    p = json_decode_non_ascii(p, end, &u);
+    unsigned units[2] = { u, 0 };
+    int count = 1;
+    if (u >= 0x10000) {
+        units[0] = 0xd800 + ((u - 0x10000) >> 10);
+        units[1] = 0xdc00 + ((u - 0x10000) & 0x3ff);
+        count = 2;
+    }
+    for (int i = 0; i < count; i ++) {
+        char* w = json_context_push(c, 6);
+        w[0] = '\\';
+        w[1] = 'u';
+        w[2] = hex_digits[units[i] >> 12];
+        w[3] = hex_digits[(units[i] >> 8) & 15];
+        w[4] = hex_digits[(units[i] >> 4) & 15];
+        w[5] = hex_digits[units[i] & 15];
+    }
+    return p;
+}
+static void json_stringify_string(json_context* c, const char* s, size_t len) {
+    static const char upper_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+    static const char lower_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    const char* hex_digits = c->format & JSON_STRINGIFY_SORT_KEYS ? lower_digits : upper_digits; // RFC 8785要求小写
+    assert(s != NULL);
+    const char* p = s, * end = s + len;
+    PUTC(c, '\"');
+    for (;;) {
+        // 需要转义的字符集合和解析时要停下来的字符集合相同，复用同一个扫描函数
+        const char* q = json_scan_string(p, end);
+        if (c->format & JSON_STRINGIFY_ASCII) {
+            const char* r = p;
+            while (r != q && (unsigned char)*r < 0x80) {
+                r ++;
+            }
+            if (r != q) { // 先写出前面的ASCII字符，再转义一个非ASCII字符
+                if (r != p) {
+                    PUTS(c, p, r - p);
+                }
+                p = json_stringify_non_ascii(c, r, end, hex_digits);
+                continue;
+            }
+        }
+        if (c->writer != NULL && (size_t)(q - p) >= c->size) { // 放不进缓冲区的长字符串直接交给writer，不拷贝
+            json_context_flush(c);
+            if (!c->stopped && !c->writer(c->ud, p, q - p)) {
+                c->stopped = 1;
+            }
+        } else if (q != p) {
+            PUTS(c, p, q - p);
+        }
+        if (q == end) {
+            break;
+        }
+        unsigned char ch = (unsigned char)*q;
+        char esc[6] = { '\\' };
+        size_t n = 2;
+        switch (ch) {
+            case '\"': esc[1] = '\"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b';  break;
+            case '\f': esc[1] = 'f';  break;
+            case '\n': esc[1] = 'n';  break;
+            case '\r': esc[1] = 'r';  break;
+            case '\t': esc[1] = 't';  break;
+            default: {
+                esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+                esc[4] = hex_digits[ch >> 4];
+                esc[5] = hex_digits[ch & 15];
+                n = 6;
+            }
+        }
+        PUTS(c, esc, n);
+        p = q + 1;
+    }
+    PUTC(c, '\"');
+}
+// json_stringify_string输出的字节数(含两个引号)，不写出任何内容
+static size_t json_stringify_string_length(const json_context* c, const char* s, size_t len) {
+    const char* p = s, * end = s + len;
+    size_t n = len + 2;
+    for (;;) {
+        const char* q = json_scan_string(p, end);
+        if (c->format & JSON_STRINGIFY_ASCII) {
+            const char* r = p;
+            while (r != q && (unsigned char)*r < 0x80) {
+                r ++;
+            }
+            if (r != q) {
+                unsigned u;
+                p = json_decode_non_ascii(r, end, &u);
+                n += (u >= 0x10000 ? 12 : 6) - (size_t)(p - r);
+                continue;
+            }
+        }
+        if (q == end) {
+            break;
+        }
+        switch (*q) {
+            case '\"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t': n += 1; break;
+            default: n += 5; // \u00XX
         }
+        p = q + 1;
     }
-    assert(c.top == 0);
-    free(c.stack);
-    return ret;
+    return n;
 }
+// Grisu2：用64位整数运算求出能够唯一还原该double的最短十进制数字
+typedef struct { uint64_t f; int e; } json_diyfp;
 
-void json_free(json_value* v) {
-    assert(v != NULL);
-    switch (v->type) {
-        case JSON_STRING: {
-            free(v->u.s.s);
-            break;
+static json_diyfp json_diyfp_make(uint64_t f, int e) {
+    json_diyfp r;
+    r.f = f;
+    r.e = e;
+    return r;
+}
+static json_diyfp json_diyfp_mul(json_diyfp x, json_diyfp y) { // 128位乘积的高64位，四舍五入
+    const uint64_t M32 = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1U << 31;
+    return json_diyfp_make(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+static json_diyfp json_diyfp_normalize(json_diyfp x) {
+    while (!(x.f & ((uint64_t)1 << 63))) {
+        x.f <<= 1;
+        x.e --;
+    }
+    return x;
+}
+static json_diyfp json_cached_power_index(unsigned index) { // 10^(index * 8 - 348)
+    static const uint64_t cached_f[] = {
+        0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+        0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+        0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+        0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+        0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+        0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+        0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+        0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+        0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+        0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+        0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+        0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+        0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+        0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+        0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+        0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+        0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+        0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+        0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+        0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+        0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+        0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL    };
+    static const short cached_e[] = {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+        -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+        -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+        -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+        56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+        375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+        694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+        1013, 1039, 1066    };
+    return json_diyfp_make(cached_f[index], cached_e[index]);
+}
+static json_diyfp json_cached_power(int e, int* K) { // 10^-K，使乘积的指数落在[-60, -32]之间
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // dk必须为正数，这样向上取整才正确
+    int k = (int)dk;
+    if (dk - k > 0.0) {
+        k ++;
+    }
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    return json_cached_power_index(index);
+}
+// 十进制转double：先用上面的缓存10的幂做64位近似乘法并估计误差(与Grisu共用表)，
+// 误差范围内无法确定舍入方向时再用大整数和两个double的中点精确比较，结果总是正确舍入，与locale无关
+#define JSON_STRTOD_DIGITS 768 // 两个相邻double的中点最多767位有效数字，保留768位再加一位粘滞位就足以判断
+#define JSON_BIGINT_WORDS 128  // 比较时的大整数不超过约2600位
+
+typedef struct { uint32_t w[JSON_BIGINT_WORDS]; int n; } json_bigint; // 低位在前，n个有效字，最高字不为0
+
+static void json_bigint_set(json_bigint* b, uint64_t u) {
+    b->n = 0;
+    for (; u != 0; u >>= 32) {
+        b->w[b->n ++] = (uint32_t)u;
+    }
+}
+static void json_bigint_mul_add(json_bigint* b, uint32_t m, uint32_t a) { // b = b * m + a
+    uint64_t carry = a;
+    for (int i = 0; i < b->n; i ++) {
+        carry += (uint64_t)b->w[i] * m;
+        b->w[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry != 0) {
+        assert(b->n < JSON_BIGINT_WORDS);
+        b->w[b->n ++] = (uint32_t)carry;
+    }
+}
+static void json_bigint_mul_pow5(json_bigint* b, int e) {
+    static const uint32_t pow5[] = { 1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625 };
+    for (; e >= 13; e -= 13) {
+        json_bigint_mul_add(b, 1220703125u, 0);
+    }
+    if (e > 0) {
+        json_bigint_mul_add(b, pow5[e], 0);
+    }
+}
+static void json_bigint_shl(json_bigint* b, int s) {
+    int words = s >> 5, bits = s & 31;
+    if (b->n == 0 || s == 0) {
+        return;
+    }
+    assert(b->n + words < JSON_BIGINT_WORDS);
+    if (bits == 0) {
+        memmove(b->w + words, b->w, b->n * sizeof(uint32_t));
+    } else {
+        b->w[b->n + words] = b->w[b->n - 1] >> (32 - bits);
+        for (int i = b->n - 1; i > 0; i --) {
+            b->w[i + words] = (b->w[i] << bits) | (b->w[i - 1] >> (32 - bits));
         }
-        case JSON_ARRAY: {
-            for (int i = 0; i < v->u.a.size; i ++) {
-                json_free(&v->u.a.e[i]);
-            }
-            free(v->u.a.e);
-            break;
+        b->w[words] = b->w[0] << bits;
+        b->n ++;
+    }
+    memset(b->w, 0, words * sizeof(uint32_t));
+    b->n += words;
+    if (b->w[b->n - 1] == 0) {
+        b->n --;
+    }
+}
+static int json_bigint_cmp(const json_bigint* a, const json_bigint* b) {
+    if (a->n != b->n) {
+        return a->n < b->n ? -1 : 1;
+    }
+    for (int i = a->n - 1; i >= 0; i --) {
+        if (a->w[i] != b->w[i]) {
+            return a->w[i] < b->w[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+static void json_bigint_sub(json_bigint* a, const json_bigint* b) { // a -= b，要求a >= b
+    uint64_t borrow = 0;
+    for (int i = 0; i < a->n; i ++) {
+        uint64_t t = (uint64_t)a->w[i] - (i < b->n ? b->w[i] : 0) - borrow;
+        a->w[i] = (uint32_t)t;
+        borrow = t >> 63;
+    }
+    while (a->n > 0 && a->w[a->n - 1] == 0) {
+        a->n --;
+    }
+}
+// 十进制数decimals * 10^dexp(decimals不含前导零)的近似值，能确定是正确舍入的结果时返回1
+static int json_strtod_diyfp(const char* decimals, int dlen, int dexp, double* d) {
+    static const uint64_t pow10_f[] = { // 10^1 ~ 10^7，补足缓存表8的步长
+        0xa000000000000000ULL, 0xc800000000000000ULL, 0xfa00000000000000ULL, 0x9c40000000000000ULL,
+        0xc350000000000000ULL, 0xf424000000000000ULL, 0x9896800000000000ULL };
+    static const int pow10_e[] = { -60, -57, -54, -50, -47, -44, -40 };
+    const uint64_t hidden = (uint64_t)1 << 52;
+    const int ulp_shift = 3, ulp = 1 << ulp_shift; // 误差以1/8个最低位为单位
+    uint64_t significand = 0;
+    int i = 0;
+    for (; i < dlen && i < 19; i ++) {
+        significand = significand * 10 + (decimals[i] - '0');
+    }
+    if (i < dlen && decimals[i] >= '5') {
+        significand ++;
+    }
+    int64_t error = i < dlen ? ulp / 2 : 0;
+    json_diyfp v = json_diyfp_normalize(json_diyfp_make(significand, 0));
+    error <<= -v.e;
+    dexp += dlen - i;
+    unsigned index = (unsigned)(dexp + 348) >> 3;
+    int adjust = dexp - (-348 + (int)(index << 3));
+    if (adjust != 0) {
+        v = json_diyfp_mul(v, json_diyfp_make(pow10_f[adjust - 1], pow10_e[adjust - 1]));
+        if (dlen + adjust > 19) {
+            error += ulp / 2;
+        }
+    }
+    v = json_diyfp_mul(v, json_cached_power_index(index));
+    error += ulp + (error == 0 ? 0 : 1);
+    int old_e = v.e;
+    v = json_diyfp_normalize(v);
+    error <<= old_e - v.e;
+    // 非规格化数的有效位数少于53位，多出的低位都要舍入
+    int order = 64 + v.e;
+    if (order <= -1074) { // 小于最小的非规格化数，在0和它之间精确比较
+        *d = 0.0;
+        return 0;
+    }
+    int precision = 64 - (order >= -1021 ? 53 : order + 1074);
+    if (precision + ulp_shift >= 64) {
+        int scale = precision + ulp_shift - 63;
+        v.f >>= scale;
+        v.e += scale;
+        error = (error >> scale) + 1 + ulp;
+        precision -= scale;
+    }
+    json_diyfp r = json_diyfp_make(v.f >> precision, v.e + precision);
+    uint64_t rest = (v.f & (((uint64_t)1 << precision) - 1)) * ulp;
+    uint64_t half = ((uint64_t)1 << (precision - 1)) * ulp;
+    if (rest >= half + (uint64_t)error) {
+        r.f ++;
+        if (r.f & (hidden << 1)) {
+            r.f >>= 1;
+            r.e ++;
+        }
+    }
+    uint64_t bits;
+    if ((r.f & hidden) && r.e + 1075 >= 0x7FF) { // 近似值已经溢出，从DBL_MAX开始精确比较
+        *d = DBL_MAX;
+        return 0;
+    }
+    bits = (r.f & (hidden - 1)) | ((uint64_t)((r.f & hidden) ? r.e + 1075 : 0) << 52);
+    memcpy(d, &bits, sizeof(bits));
+    return half - (uint64_t)error >= rest || rest >= half + (uint64_t)error;
+}
+// 近似值b与精确值之差和b的半个最低位比较，需要时调整到相邻的double
+static double json_strtod_bigint(double b, const char* decimals, int dlen, int dexp) {
+    const uint64_t hidden = (uint64_t)1 << 52;
+    uint64_t bits, f;
+    memcpy(&bits, &b, sizeof(bits));
+    int biased_e = (int)(bits >> 52), b_e;
+    f = bits & (hidden - 1);
+    if (biased_e != 0) {
+        f |= hidden;
+        b_e = biased_e - 1075;
+    } else {
+        b_e = 1 - 1075;
+    }
+    // 精确值d = decimals * 10^dexp，b = f * 2^b_e，半个最低位h = 2^(b_e - 1)，三者乘上相同的因子化为整数
+    int d2 = 0, d5 = 0, b2 = 0, b5 = 0, h2 = 0, h5 = 0;
+    if (dexp >= 0) {
+        d2 += dexp;
+        d5 += dexp;
+    } else {
+        b2 -= dexp;
+        b5 -= dexp;
+        h2 -= dexp;
+        h5 -= dexp;
+    }
+    if (b_e >= 0) {
+        b2 += b_e;
+    } else {
+        d2 -= b_e;
+        h2 -= b_e;
+    }
+    if (b_e - 1 >= 0) {
+        h2 += b_e - 1;
+    } else {
+        d2 -= b_e - 1;
+        b2 -= b_e - 1;
+    }
+    int common = d2 < b2 ? d2 : b2;
+    common = common < h2 ? common : h2;
+    json_bigint ds, bs, hs;
+    json_bigint_set(&ds, 0);
+    for (int i = 0; i < dlen; ) { // 每次累加9位
+        uint32_t chunk = 0, m = 1;
+        for (int j = 0; j < 9 && i < dlen; j ++, i ++) {
+            chunk = chunk * 10 + (decimals[i] - '0');
+            m *= 10;
+        }
+        json_bigint_mul_add(&ds, m, chunk);
+    }
+    json_bigint_mul_pow5(&ds, d5);
+    json_bigint_shl(&ds, d2 - common);
+    json_bigint_set(&bs, f);
+    json_bigint_mul_pow5(&bs, b5);
+    json_bigint_shl(&bs, b2 - common);
+    json_bigint_set(&hs, 1);
+    json_bigint_mul_pow5(&hs, h5);
+    json_bigint_shl(&hs, h2 - common);
+    int cmp = json_bigint_cmp(&ds, &bs), up = cmp > 0;
+    if (cmp == 0) {
+        return b;
+    } else if (up) {
+        json_bigint_sub(&ds, &bs);
+        cmp = json_bigint_cmp(&ds, &hs);
+    } else {
+        json_bigint_sub(&bs, &ds);
+        if (f == hidden && biased_e > 1) { // 2的整数次幂，下方相邻double的间距只有一半
+            json_bigint_shl(&bs, 1);
+        }
+        cmp = json_bigint_cmp(&bs, &hs);
+    }
+    if (cmp < 0 || (cmp == 0 && !(f & 1))) { // 正好在中点时舍入到偶数
+        return b;
+    }
+    bits = up ? bits + 1 : bits - 1; // DBL_MAX加1是inf
+    memcpy(&b, &bits, sizeof(bits));
+    return b;
+}
+// p到end是不含负号、已经检查过语法的数字，结果超出double的范围时返回0
+static int json_strtod(const char* p, const char* end, double* d) {
+    char decimals[JSON_STRTOD_DIGITS + 1];
+    int dlen = 0, dexp = 0, sticky = 0;
+#define STRTOD_DIGIT(ch) do { if (dlen < JSON_STRTOD_DIGITS) { if (dlen != 0 || (ch) != '0') decimals[dlen ++] = (ch); } else { sticky |= (ch) != '0'; dexp ++; } } while(0)
+    for (; p != end && ISDIGIT(*p); p ++) {
+        STRTOD_DIGIT(*p);
+    }
+    if (p != end && *p == '.') {
+        for (p ++; p != end && ISDIGIT(*p); p ++) {
+            STRTOD_DIGIT(*p);
+            dexp --;
         }
-        case JSON_OBJECT: {
-            for (int i = 0; i < v->u.o.size; i ++) {
-                free(v->u.o.m[i].k);
-                json_free(&v->u.o.m[i].v);
+    }
+#undef STRTOD_DIGIT
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        int eneg = 0, e = 0;
+        p ++;
+        if (*p == '+' || *p == '-') {
+            eneg = *p == '-';
+            p ++;
+        }
+        for (; p != end && ISDIGIT(*p); p ++) {
+            if (e < 100000) {
+                e = e * 10 + (*p - '0');
             }
-            free(v->u.o.m);
-            break;
         }
-        default: {
-            break;
+        dexp += eneg ? -e : e;
+    }
+    if (sticky) { // 截掉的数字不全为0，补一位1使它不会恰好落在中点上
+        decimals[dlen ++] = '1';
+        dexp --;
+    } else {
+        while (dlen > 0 && decimals[dlen - 1] == '0') {
+            dlen --;
+            dexp ++;
         }
     }
-    v->type = JSON_NULL;
+    if (dlen == 0 || dlen + dexp <= -324) { // 小于10^-324，舍入为0
+        *d = 0.0;
+        return 1;
+    }
+    if (dlen + dexp > 309) { // 不小于10^309
+        return 0;
+    }
+    if (!json_strtod_diyfp(decimals, dlen, dexp, d)) {
+        *d = json_strtod_bigint(*d, decimals, dlen, dexp);
+    }
+    return *d <= DBL_MAX;
+}
+static void json_grisu_round(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1] --;
+        rest += ten_kappa;
+    }
 }
+static int json_grisu2(double d, char* buf, int* K) {
+    static const uint32_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    const uint64_t hidden = (uint64_t)1 << 52;
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & (hidden - 1);
+    json_diyfp v = biased_e != 0 ? json_diyfp_make(significand + hidden, biased_e - 1075) : json_diyfp_make(significand, 1 - 1075);
 
+    // 相邻double的中点m-和m+，规格化到同一个指数
+    json_diyfp pl = json_diyfp_make((v.f << 1) + 1, v.e - 1);
+    while (!(pl.f & (hidden << 1))) {
+        pl.f <<= 1;
+        pl.e --;
+    }
+    pl.f <<= 10;
+    pl.e -= 10;
+    json_diyfp mi = v.f == hidden ? json_diyfp_make((v.f << 2) - 1, v.e - 2) : json_diyfp_make((v.f << 1) - 1, v.e - 1);
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
 
+    json_diyfp c_mk = json_cached_power(pl.e, K);
+    json_diyfp W = json_diyfp_mul(json_diyfp_normalize(v), c_mk);
+    json_diyfp Wp = json_diyfp_mul(pl, c_mk);
+    json_diyfp Wm = json_diyfp_mul(mi, c_mk);
+    Wm.f ++;
+    Wp.f --;
 
-static void json_stringify_string(json_context* c, const char* s, size_t len) {
-    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    assert(s != NULL);
-    size_t size;
-    char* head, * p;
-    p = head = json_context_push(c, size = len * 6 + 2);
-    *p ++ = '\"';
-    for (int i = 0; i < len; i ++) {
-        unsigned char ch = (unsigned char)s[i];
-        switch (ch) {
-            case '\"': *p ++ = '\\'; *p ++ = '\"'; break;
-            case '\\': *p ++ = '\\'; *p ++ = '\\'; break;
-            case '\b': *p ++ = '\\'; *p ++ = 'b';  break;
-            case '\f': *p ++ = '\\'; *p ++ = 'f';  break;
-            case '\n': *p ++ = '\\'; *p ++ = 'n';  break;
-            case '\r': *p ++ = '\\'; *p ++ = 'r';  break;
-            case '\t': *p ++ = '\\'; *p ++ = 't';  break;
-            default: {
-                if (ch < 0x20) {
-                    *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
-                    *p++ = hex_digits[ch >> 4];
-                    *p++ = hex_digits[ch & 15];
-                } else {
-                    *p++ = s[i];
-                }
-            }
+    // 生成数字，直到剩余部分落在(Wm, Wp)之内
+    uint64_t delta = Wp.f - Wm.f;
+    json_diyfp one = json_diyfp_make((uint64_t)1 << -Wp.e, Wp.e);
+    uint64_t wp_w = Wp.f - W.f;
+    uint32_t p1 = (uint32_t)(Wp.f >> -one.e);
+    uint64_t p2 = Wp.f & (one.f - 1);
+    int kappa = 1, len = 0;
+    while (kappa < 10 && p1 >= pow10[kappa]) {
+        kappa ++;
+    }
+    while (kappa > 0) {
+        uint32_t digit = p1 / pow10[kappa - 1];
+        p1 %= pow10[kappa - 1];
+        if (digit || len) {
+            buf[len ++] = (char)('0' + digit);
+        }
+        kappa --;
+        uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+        if (tmp <= delta) {
+            *K += kappa;
+            json_grisu_round(buf, len, delta, tmp, (uint64_t)pow10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+    for (uint64_t unit = 1;;) {
+        p2 *= 10;
+        delta *= 10;
+        unit *= 10;
+        char digit = (char)(p2 >> -one.e);
+        if (digit || len) {
+            buf[len ++] = (char)('0' + digit);
+        }
+        p2 &= one.f - 1;
+        kappa --;
+        if (p2 < delta) {
+            *K += kappa;
+            json_grisu_round(buf, len, delta, p2, one.f, wp_w * unit);
+            return len;
+        }
+    }
+}
+static char* json_write_uint64(char* p, uint64_t u) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n ++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    while (n > 0) {
+        *p ++ = tmp[-- n];
+    }
+    return p;
+}
+// 输出格式与"%.17g"的规则一致：十进制指数在[-4, 17)之间使用定点表示，否则使用科学计数法
+static char* json_dtoa(double d, char* p) {
+    if (signbit(d)) {
+        *p ++ = '-';
+        d = -d;
+    }
+    if (d == 0.0) {
+        *p ++ = '0';
+        return p;
+    }
+    if (d < 9007199254740992.0 && d == (double)(uint64_t)d) { // 2^53以内的整数，精确的整数形式就是最短的
+        return json_write_uint64(p, (uint64_t)d);
+    }
+    char digits[20];
+    int K;
+    int len = json_grisu2(d, digits, &K);
+    int exp10 = len + K - 1; // 第一位数字的十进制指数
+    if (exp10 >= -4 && exp10 < 17) {
+        if (K >= 0) { // 1234e2 -> 123400
+            memcpy(p, digits, len);
+            p += len;
+            memset(p, '0', K);
+            p += K;
+        } else if (exp10 >= 0) { // 1234e-2 -> 12.34
+            memcpy(p, digits, exp10 + 1);
+            p += exp10 + 1;
+            *p ++ = '.';
+            memcpy(p, digits + exp10 + 1, len - exp10 - 1);
+            p += len - exp10 - 1;
+        } else { // 1234e-6 -> 0.001234
+            *p ++ = '0';
+            *p ++ = '.';
+            memset(p, '0', -exp10 - 1);
+            p += -exp10 - 1;
+            memcpy(p, digits, len);
+            p += len;
+        }
+    } else { // 1234e30 -> 1.234e+33
+        *p ++ = digits[0];
+        if (len > 1) {
+            *p ++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p ++ = 'e';
+        *p ++ = exp10 < 0 ? '-' : '+';
+        p = json_write_uint64(p, (uint64_t)(exp10 < 0 ? -exp10 : exp10));
+    }
+    return p;
+}
+static size_t json_count_digits(uint64_t u) {
+    size_t n = 1;
+    while (u >= 10) {
+        u /= 10;
+        n ++;
+    }
+    return n;
+}
+// json_dtoa输出的字节数：数字仍由Grisu2求出，但不排版
+static size_t json_dtoa_length(double d) {
+    size_t n = signbit(d) ? 1 : 0;
+    d = fabs(d);
+    if (d == 0.0) {
+        return n + 1;
+    }
+    if (d < 9007199254740992.0 && d == (double)(uint64_t)d) {
+        return n + json_count_digits((uint64_t)d);
+    }
+    char digits[20];
+    int K;
+    int len = json_grisu2(d, digits, &K);
+    int exp10 = len + K - 1;
+    if (exp10 >= -4 && exp10 < 17) {
+        if (K >= 0) { // 1234e2 -> 123400
+            return n + len + K;
+        } else if (exp10 >= 0) { // 1234e-2 -> 12.34
+            return n + len + 1;
+        } else { // 1234e-6 -> 0.001234
+            return n + 2 + (-exp10 - 1) + len;
+        }
+    }
+    // 1234e30 -> 1.234e+33
+    return n + (len > 1 ? len + 1 : 1) + 2 + json_count_digits((uint64_t)(exp10 < 0 ? -exp10 : exp10));
+}
+static void json_stringify_newline(json_context* c) {
+    if (c->indent > 0) {
+        size_t n = c->indent * c->depth;
+        PUTC(c, '\n');
+        while (n > 0) { // 分段写，缓冲区大小固定时也不会超过
+            size_t k = n < 64 ? n : 64;
+            memset(json_context_push(c, k), ' ', k);
+            n -= k;
         }
     }
-    *p ++ = '\"';
-    c->top -= size - (p - head);
 }
 static void json_stringify_value(json_context* c, const json_value* v) {
-    switch (v->type) {
-        case JSON_NULL: PUTS(c, "null", 4); break;
-        case JSON_TRUE: PUTS(c, "true", 4); break;
-        case JSON_FALSE: PUTS(c, "false", 5); break;
-        case JSON_NUMBER: c->top -= 32 - sprintf(json_context_push(c, 32), "%.17g", v->u.n); break; // sprintf返回字节数
-        case JSON_STRING: json_stringify_string(c, v->u.s.s, v->u.s.len); break;
-        case JSON_ARRAY: {
-            PUTC(c, '[');
-            for (int i = 0; i < v->u.a.size; i ++) {
-                if (i > 0) {
-                    PUTC(c, ',');
-                }
-                json_stringify_value(c, &v->u.a.e[i]);
-            }
-            PUTC(c, ']');
+    json_walk w;
+    json_walk_init(&w);
+    while (!c->stopped) {
+        RESOLVE(v);
+        switch (v->type) {
+            case JSON_NULL: PUTS(c, "null", 4); break;
+            case JSON_TRUE: PUTS(c, "true", 4); break;
+            case JSON_FALSE: PUTS(c, "false", 5); break;
+            case JSON_NUMBER: {
+                if (v->flags & JSON_FLAG_INTEGER) {
+                    char* p = json_context_push(c, 32);
+                    if (v->flags & JSON_FLAG_UINT64) {
+                        c->top -= 32 - (json_write_uint64(p, v->u.ui) - p);
+                    } else if (v->u.i < 0) {
+                        *p = '-';
+                        c->top -= 32 - (json_write_uint64(p + 1, 0 - (uint64_t)v->u.i) - p);
+                    } else {
+                        c->top -= 32 - (json_write_uint64(p, (uint64_t)v->u.i) - p);
+                    }
+                } else if (!isfinite(v->u.n)) { // JSON中没有inf和nan
+                    PUTS(c, "null", 4);
+                } else {
+                    char* p = json_context_push(c, 32);
+                    c->top -= 32 - (json_dtoa(v->u.n, p) - p);
+                }
+                break;
+            }
+            case JSON_STRING: json_stringify_string(c, v->u.s.s, v->u.s.len); break;
+            case JSON_ARRAY: {
+                PUTC(c, '[');
+                if (v->u.a.size == 0) {
+                    PUTC(c, ']');
+                } else {
+                    json_walk_push(&w, v, NULL);
+                    c->depth ++;
+                }
+                break;
+            }
+            case JSON_OBJECT: {
+                PUTC(c, '{');
+                if (v->u.o.size == 0) {
+                    PUTC(c, '}');
+                    break;
+                }
+                json_walk_frame* f = json_walk_push(&w, v, NULL);
+                c->depth ++;
+                if ((c->format & JSON_STRINGIFY_SORT_KEYS) && v->u.o.size > 1) {
+                    assert(v->u.o.size <= UINT32_MAX);
+                    f->idx = (uint32_t*)JSON_MALLOC(v->u.o.size * 2 * sizeof(uint32_t));
+                    for (size_t i = 0; i < v->u.o.size; i ++) {
+                        f->idx[i] = (uint32_t)i;
+                    }
+                    json_sort_members(f->idx, f->idx + v->u.o.size, v->u.o.size, v->u.o.m, json_utf16_key_less);
+                }
+                break;
+            }
+            default: assert(0 && "invalid type");
+        }
+        // 下一个要写的子值，对象成员先写出键；子值都写完的容器补上结束括号
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                c->depth --;
+                json_stringify_newline(c);
+                PUTC(c, f->v->type == JSON_ARRAY ? ']' : '}');
+                JSON_FREE(f->idx);
+                w.depth --;
+                continue;
+            }
+            if (f->i > 0) {
+                PUTC(c, ',');
+            }
+            json_stringify_newline(c);
+            if (f->v->type == JSON_ARRAY) {
+                v = &f->v->u.a.e[f->i];
+            } else {
+                const json_member* m = &f->v->u.o.m[f->idx != NULL ? f->idx[f->i] : f->i];
+                json_stringify_string(c, m->k, m->klen);
+                PUTC(c, ':');
+                if (c->indent > 0) {
+                    PUTC(c, ' ');
+                }
+                v = &m->v;
+            }
+            f->i ++;
+        }
+        if (v == NULL) {
             break;
         }
-        case JSON_OBJECT: {
-            PUTC(c, '{');
-            for (int i = 0; i < v->u.o.size; i ++) {
-                if (i > 0) {
-                    PUTC(c, ',');
+    }
+    while (w.depth > 0) { // writer停止了输出，还没写完的容器
+        JSON_FREE(w.f[-- w.depth].idx);
+    }
+    json_walk_free(&w);
+}
+// JSON_STRINGIFY_PRESIZE：按json_stringify_value的格式直接算出输出的字节数，不格式化；键的顺序不影响长度，不用排序
+static size_t json_stringify_length(const json_context* c, const json_value* v) {
+    json_walk w;
+    size_t n = 0, depth = 0;
+    json_walk_init(&w);
+    for (;;) {
+        RESOLVE(v);
+        switch (v->type) {
+            case JSON_NULL: case JSON_TRUE: n += 4; break;
+            case JSON_FALSE: n += 5; break;
+            case JSON_NUMBER: {
+                if (v->flags & JSON_FLAG_UINT64) {
+                    n += json_count_digits(v->u.ui);
+                } else if (v->flags & JSON_FLAG_INTEGER) {
+                    n += v->u.i < 0 ? 1 + json_count_digits(0 - (uint64_t)v->u.i) : json_count_digits((uint64_t)v->u.i);
+                } else {
+                    n += isfinite(v->u.n) ? json_dtoa_length(v->u.n) : 4;
                 }
-                json_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
-                PUTC(c, ':');
-                json_stringify_value(c, &v->u.o.m[i].v);
+                break;
             }
-            PUTC(c, '}');
+            case JSON_STRING: n += json_stringify_string_length(c, v->u.s.s, v->u.s.len); break;
+            case JSON_ARRAY:
+            case JSON_OBJECT: {
+                n += 2;
+                if (json_walk_size(v) > 0) {
+                    json_walk_push(&w, v, NULL);
+                    depth ++;
+                }
+                break;
+            }
+            default: assert(0 && "invalid type");
+        }
+        // 逗号、换行缩进、键和冒号
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                depth --;
+                n += c->indent > 0 ? 1 + c->indent * depth : 0;
+                w.depth --;
+                continue;
+            }
+            n += (f->i > 0) + (c->indent > 0 ? 1 + c->indent * depth : 0);
+            if (f->v->type == JSON_ARRAY) {
+                v = &f->v->u.a.e[f->i];
+            } else {
+                const json_member* m = &f->v->u.o.m[f->i];
+                n += json_stringify_string_length(c, m->k, m->klen) + 1 + (c->indent > 0);
+                v = &m->v;
+            }
+            f->i ++;
+        }
+        if (v == NULL) {
             break;
         }
-        default: assert(0 && "invalid type");
     }
+    json_walk_free(&w);
+    return n;
 }
 char* json_stringify(const json_value* v, size_t* length) {
-    assert(v != NULL);
+    return json_stringify_ex(v, length, 0, 0);
+}
+char* json_stringify_ex(const json_value* v, size_t* length, unsigned flags, unsigned indent) {
+    json_writer w;
+    json_writer_init(&w);
+    json_writer_stringify(&w, v, length, flags, indent);
+    return w.buffer; // 缓冲区直接交给调用者
+}
+int json_stringify_to(const json_value* v, json_writer_fn writer, void* ud) {
+    json_writer w;
+    json_writer_init(&w);
+    int ret = json_writer_stringify_to(&w, v, writer, ud);
+    json_writer_free(&w);
+    return ret;
+}
+void json_writer_init(json_writer* w) {
+    assert(w != NULL);
+    w->buffer = NULL;
+    w->size = 0;
+    w->scratch_allocator = json_global_allocator;
+}
+void json_writer_free(json_writer* w) {
+    assert(w != NULL);
+    json_alloc_free(&w->scratch_allocator, w->buffer);
+    w->buffer = NULL;
+    w->size = 0;
+}
+const char* json_writer_stringify(json_writer* w, const json_value* v, size_t* length, unsigned flags, unsigned indent) {
+    assert(w != NULL && v != NULL);
     json_context c;
-    c.stack = (char*)malloc(c.size = JSON_STRINGIFY_STACK_INIT_SIZE);
-    c.top = 0;
+    json_context_init(&c, NULL, 0);
+    c.format = flags;
+    c.indent = indent;
+    c.stack = w->buffer;
+    c.size = w->size;
+    c.alloc = &w->scratch_allocator;
+    size_t n = 0;
+    if (flags & JSON_STRINGIFY_PRESIZE) { // 先算出输出的字节数
+        n = json_stringify_length(&c, v);
+        if (c.size < n + 33) { // 写数字时先预留32个字节再退回，再加上结尾的'\0'
+            json_alloc_free(c.alloc, c.stack);
+            c.stack = (char*)json_alloc_malloc(c.alloc, c.size = n + 33);
+        }
+    } else if (c.stack == NULL) {
+        c.stack = (char*)json_alloc_malloc(c.alloc, c.size = JSON_STRINGIFY_STACK_INIT_SIZE);
+    }
+    size_t size = c.size;
     json_stringify_value(&c, v);
     if (length) {
         *length = c.top;
     }
     PUTC(&c, '\0');
+    assert(!(flags & JSON_STRINGIFY_PRESIZE) || (c.size == size && c.top == n + 1));
+    (void)size;
+    (void)n;
+    w->buffer = c.stack;
+    w->size = c.size;
     return c.stack;
 }
+int json_writer_stringify_to(json_writer* w, const json_value* v, json_writer_fn writer, void* ud) {
+    assert(w != NULL && v != NULL && writer != NULL);
+    json_context c;
+    json_context_init(&c, NULL, 0);
+    if (w->size < JSON_WRITER_BUFFER_SIZE) {
+        json_alloc_free(&w->scratch_allocator, w->buffer);
+        w->buffer = (char*)json_alloc_malloc(&w->scratch_allocator, w->size = JSON_WRITER_BUFFER_SIZE);
+    }
+    c.stack = w->buffer;
+    c.size = JSON_WRITER_BUFFER_SIZE; // 缓冲区可能比这大，每次交给writer的字节数仍不超过JSON_WRITER_BUFFER_SIZE
+    c.writer = writer;
+    c.ud = ud;
+    json_stringify_value(&c, v);
+    json_context_flush(&c);
+    w->buffer = c.stack;
+    if (c.size != JSON_WRITER_BUFFER_SIZE) { // 扩容时realloc到了c.size
+        w->size = c.size;
+    }
+    return c.stopped ? JSON_PARSE_STOPPED : JSON_PARSE_OK;
+}
 
-void json_copy(json_value* dst, const json_value* src) {
-    assert(src != NULL && dst != NULL && dst != src);
-    switch (src->type) {
-        case JSON_STRING: { // 深度拷贝
-            json_set_string(dst, src->u.s.s, src->u.s.len);
+/* CBOR(RFC 8949)：每个值以一个字节开头，高3位是主类型，低5位小于24时就是参数，24~27表示参数在后面的1/2/4/8个字节中(大端)。
+   整数、浮点数按二进制保存，字符串和容器前面是长度/元素个数，读取时不需要转义和数字转换 */
+#define JSON_CBOR_UINT   0
+#define JSON_CBOR_NEGINT 1
+#define JSON_CBOR_TEXT   3
+#define JSON_CBOR_ARRAY  4
+#define JSON_CBOR_MAP    5
+#define JSON_CBOR_SIMPLE 7
+static void json_cbor_put_head(json_context* c, unsigned major, uint64_t n) {
+    if (n < 24) {
+        PUTC(c, (char)(major << 5 | n));
+        return;
+    }
+    int bytes = n <= 0xff ? 1 : n <= 0xffff ? 2 : n <= 0xffffffff ? 4 : 8;
+    unsigned char* p = (unsigned char*)json_context_push(c, 1 + bytes);
+    p[0] = (unsigned char)(major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27));
+    for (int i = bytes; i > 0; i --, n >>= 8) {
+        p[i] = (unsigned char)n;
+    }
+}
+static void json_cbor_put_text(json_context* c, const char* s, size_t len) {
+    json_cbor_put_head(c, JSON_CBOR_TEXT, len);
+    if (len > 0) {
+        PUTS(c, s, len);
+    }
+}
+static void json_cbor_put_value(json_context* c, const json_value* v) {
+    json_walk w;
+    json_walk_init(&w);
+    for (;;) {
+        RESOLVE(v);
+        switch (v->type) {
+            case JSON_NULL: PUTC(c, (char)0xf6); break;
+            case JSON_FALSE: PUTC(c, (char)0xf4); break;
+            case JSON_TRUE: PUTC(c, (char)0xf5); break;
+            case JSON_NUMBER: {
+                if (v->flags & JSON_FLAG_UINT64) {
+                    json_cbor_put_head(c, JSON_CBOR_UINT, v->u.ui);
+                } else if (v->flags & JSON_FLAG_INT64) { // 负数保存为-1-n，即~n
+                    json_cbor_put_head(c, v->u.i < 0 ? JSON_CBOR_NEGINT : JSON_CBOR_UINT, v->u.i < 0 ? ~(uint64_t)v->u.i : (uint64_t)v->u.i);
+                } else if (isinf(v->u.n) || (fabs(v->u.n) <= FLT_MAX && (double)(float)v->u.n == v->u.n)) { // float能精确表示时只用4个字节；超出float范围时转换是未定义行为，先排除，nan保留原来的8字节
+                    float f = (float)v->u.n;
+                    uint32_t bits;
+                    memcpy(&bits, &f, sizeof(bits));
+                    unsigned char* p = (unsigned char*)json_context_push(c, 5);
+                    p[0] = 0xfa;
+                    for (int i = 4; i > 0; i --, bits >>= 8) {
+                        p[i] = (unsigned char)bits;
+                    }
+                } else {
+                    uint64_t bits;
+                    memcpy(&bits, &v->u.n, sizeof(bits));
+                    unsigned char* p = (unsigned char*)json_context_push(c, 9);
+                    p[0] = 0xfb;
+                    for (int i = 8; i > 0; i --, bits >>= 8) {
+                        p[i] = (unsigned char)bits;
+                    }
+                }
+                break;
+            }
+            case JSON_STRING: json_cbor_put_text(c, v->u.s.s, v->u.s.len); break;
+            case JSON_ARRAY: { // 元素在遍历到时再写
+                json_cbor_put_head(c, JSON_CBOR_ARRAY, v->u.a.size);
+                if (v->u.a.size > 0) {
+                    json_walk_push(&w, v, NULL);
+                }
+                break;
+            }
+            case JSON_OBJECT: {
+                json_cbor_put_head(c, JSON_CBOR_MAP, v->u.o.size);
+                if (v->u.o.size > 0) {
+                    json_walk_push(&w, v, NULL);
+                }
+                break;
+            }
+            default: assert(0 && "invalid type");
+        }
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                w.depth --;
+            } else if (f->v->type == JSON_ARRAY) {
+                v = &f->v->u.a.e[f->i ++];
+            } else {
+                const json_member* m = &f->v->u.o.m[f->i ++];
+                json_cbor_put_text(c, m->k, m->klen);
+                v = &m->v;
+            }
+        }
+        if (v == NULL) {
+            break;
+        }
+    }
+    json_walk_free(&w);
+}
+char* json_to_cbor(const json_value* v, size_t* length) {
+    assert(v != NULL && length != NULL);
+    json_context c;
+    json_context_init(&c, NULL, 0);
+    c.stack = (char*)JSON_MALLOC(c.size = JSON_STRINGIFY_STACK_INIT_SIZE);
+    json_cbor_put_value(&c, v);
+    *length = c.top;
+    return c.stack;
+}
+// 读取一个值的头部，主类型放在major中，参数(或浮点数的位)放在n中，返回低5位
+static int json_cbor_get_head(json_context* c, unsigned* major, uint64_t* n) {
+    const unsigned char* p = (const unsigned char*)c->json;
+    unsigned info = *p & 0x1f;
+    *major = *p ++ >> 5;
+    if (info < 24) {
+        *n = info;
+    } else if (info <= 27) {
+        size_t bytes = (size_t)1 << (info - 24);
+        if ((size_t)(c->end - (const char*)p) < bytes) {
+            return -1;
+        }
+        for (*n = 0; bytes > 0; bytes --) {
+            *n = *n << 8 | *p ++;
+        }
+    } else { // 不定长度和保留值，写入时不会产生
+        return -1;
+    }
+    c->json = (const char*)p;
+    return (int)info;
+}
+static double json_cbor_half(unsigned h) {
+    int e = (h >> 10) & 0x1f;
+    double m = h & 0x3ff;
+    double d = e == 0 ? ldexp(m, -24) : e != 31 ? ldexp(m + 1024, e - 25) : m == 0 ? INFINITY : NAN;
+    return h & 0x8000 ? -d : d;
+}
+// 读取一个值，数组和对象只读头部并分配好空间，子值由json_cbor_get_value逐个读取
+static int json_cbor_get_item(json_context* c, json_value* v) {
+    unsigned major;
+    uint64_t n;
+    if (c->json == c->end) {
+        return JSON_PARSE_INVALID_CBOR;
+    }
+    int info = json_cbor_get_head(c, &major, &n);
+    if (info < 0) {
+        return JSON_PARSE_INVALID_CBOR;
+    }
+    size_t rest = c->end - c->json;
+    switch (major) {
+        case JSON_CBOR_UINT: json_set_uint64(v, n); return JSON_PARSE_OK;
+        case JSON_CBOR_NEGINT: {
+            if (n <= INT64_MAX) {
+                json_set_int64(v, -1 - (int64_t)n);
+            } else {
+                json_set_number(v, -1.0 - (double)n);
+            }
+            return JSON_PARSE_OK;
+        }
+        case JSON_CBOR_TEXT: {
+            if (n > rest) {
+                return JSON_PARSE_INVALID_CBOR;
+            }
+            json_set_string(v, c->json, n);
+            c->json += n;
+            return JSON_PARSE_OK;
+        }
+        case JSON_CBOR_ARRAY: {
+            if (n > rest) { // 每个元素至少一个字节，先检查长度再分配
+                return JSON_PARSE_INVALID_CBOR;
+            }
+            json_set_array(v, n);
+            return JSON_PARSE_OK;
+        }
+        case JSON_CBOR_MAP: {
+            if (n > rest / 2) {
+                return JSON_PARSE_INVALID_CBOR;
+            }
+            json_context_set_object(c, v, n);
+            return JSON_PARSE_OK;
+        }
+        case JSON_CBOR_SIMPLE: {
+            switch (info) {
+                case 20: v->type = JSON_FALSE; return JSON_PARSE_OK;
+                case 21: v->type = JSON_TRUE; return JSON_PARSE_OK;
+                case 22: v->type = JSON_NULL; return JSON_PARSE_OK;
+                case 25: json_set_number(v, json_cbor_half((unsigned)n)); return JSON_PARSE_OK;
+                case 26: {
+                    uint32_t bits = (uint32_t)n;
+                    float f;
+                    memcpy(&f, &bits, sizeof(f));
+                    json_set_number(v, f);
+                    return JSON_PARSE_OK;
+                }
+                case 27: {
+                    double d;
+                    memcpy(&d, &n, sizeof(d));
+                    json_set_number(v, d);
+                    return JSON_PARSE_OK;
+                }
+                default: return JSON_PARSE_INVALID_CBOR;
+            }
+        }
+        default: return JSON_PARSE_INVALID_CBOR; // 字节串和标签在JSON中没有对应的类型
+    }
+}
+// 容器记录在显式栈上，嵌套深度只受json_set_max_depth限制；出错时v中是已经读出的部分，由调用者释放
+static int json_cbor_get_value(json_context* c, json_value* v) {
+    json_walk w;
+    json_walk_init(&w);
+    int ret;
+    for (;;) {
+        if ((ret = json_cbor_get_item(c, v)) != JSON_PARSE_OK) {
             break;
         }
-        case JSON_ARRAY: { // 深度拷贝
-            json_set_array(dst, src->u.a.size);
-            for (size_t i = 0; i < src->u.a.size; i ++) {
-                json_copy(&dst->u.a.e[i], &src->u.a.e[i]);
+        if (v->type == JSON_ARRAY || v->type == JSON_OBJECT) {
+            if (w.depth >= c->max_depth) {
+                ret = JSON_PARSE_TOO_DEEP;
+                break;
+            }
+            json_walk_push(&w, v, NULL); // 空容器也压栈，弹出时统一处理
+        }
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            json_value* p = (json_value*)f->v;
+            if (p->type == JSON_ARRAY) {
+                if (f->i == p->u.a.capacity) {
+                    w.depth --;
+                } else {
+                    v = &p->u.a.e[f->i ++];
+                    json_init(v);
+                    p->u.a.size = f->i;
+                }
+            } else if (f->i == p->u.o.capacity) {
+                if (p->flags & JSON_FLAG_INDEXED) {
+                    json_object_rebuild_index(p);
+                }
+                w.depth --;
+            } else {
+                unsigned major;
+                uint64_t klen;
+                if (c->json == c->end || json_cbor_get_head(c, &major, &klen) < 0 || major != JSON_CBOR_TEXT
+                    || klen > (size_t)(c->end - c->json)) {
+                    ret = JSON_PARSE_INVALID_CBOR;
+                    break;
+                }
+                json_member* m = &p->u.o.m[f->i ++];
+                m->k = json_context_strdup(c, c->json, klen);
+                m->klen = klen;
+                c->json += klen;
+                json_init(&m->v);
+                p->u.o.size ++;
+                v = &m->v;
             }
-            dst->u.a.size =  src->u.a.size;
+        }
+        if (v == NULL) {
             break;
         }
-        case JSON_OBJECT: { // 深度拷贝
-            json_set_object(dst, src->u.o.size);
-            for (size_t i = 0; i < src->u.o.size; i ++) {
-                json_value* v = json_set_object_value(dst, src->u.o.m[i].k, src->u.o.m[i].klen);
-                json_copy(v, &src->u.o.m[i].v);
+    }
+    json_walk_free(&w);
+    return ret;
+}
+int json_from_cbor(json_value* v, const char* data, size_t len) {
+    assert(v != NULL && (data != NULL || len == 0));
+    json_context c;
+    json_context_init(&c, data, len);
+    json_init(v);
+    if (len == 0) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    int ret = json_cbor_get_value(&c, v);
+    if (ret == JSON_PARSE_OK && c.json != c.end) {
+        ret = JSON_PARSE_ROOT_NOT_SINGULAR;
+    }
+    if (ret != JSON_PARSE_OK) {
+        json_free(v);
+    }
+    return ret;
+}
+
+void json_copy(json_value* dst, const json_value* src) {
+    assert(src != NULL && dst != NULL && dst != src);
+    json_walk w;
+    json_walk_init(&w);
+    for (;;) {
+        RESOLVE(src);
+        switch (src->type) {
+            case JSON_STRING: { // 深度拷贝
+                json_set_string(dst, src->u.s.s, src->u.s.len);
+                break;
+            }
+            case JSON_ARRAY: { // 深度拷贝，元素在遍历到时再追加
+                json_set_array(dst, src->u.a.size);
+                if (src->u.a.size > 0) {
+                    json_walk_push(&w, src, dst);
+                }
+                break;
+            }
+            case JSON_OBJECT: { // 深度拷贝，成员在遍历到时再加入
+                json_set_object(dst, src->u.o.size);
+                if (src->u.o.size > 0) {
+                    json_walk_push(&w, src, dst);
+                }
+                break;
+            }
+            default: {
+                json_free(dst);
+                memcpy(dst, src, sizeof(json_value));
+                break;
+            }
+        }
+        src = NULL;
+        while (src == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                w.depth --;
+            } else if (f->v->type == JSON_ARRAY) {
+                src = &f->v->u.a.e[f->i ++];
+                dst = &f->w->u.a.e[f->w->u.a.size ++];
+                json_init(dst); // 新分配的元素未初始化，拷贝时会先json_free它
+            } else {
+                const json_member* m = &f->v->u.o.m[f->i ++];
+                src = &m->v;
+                dst = json_set_object_value(f->w, m->k, m->klen);
             }
-            dst->u.o.size = src->u.o.size;
-            break;
         }
-        default: {
-            json_free(dst);
-            memcpy(dst, src, sizeof(json_value));
+        if (src == NULL) {
             break;
         }
     }
+    json_walk_free(&w);
 }
 void json_move(json_value* dst, json_value* src) {
     assert(src != NULL && dst != NULL && dst != src);
@@ -503,49 +3906,98 @@ json_type json_get_type(const json_value* v) {
 }
 
 
-int json_is_equal(const json_value* lhs, const json_value* rhs) {
-    assert(lhs != NULL && rhs != NULL);
-    if (lhs->type != rhs->type) {
+// 整数之间精确比较；整数和double比较时，double必须恰好是同一个整数
+static int json_number_to_uint64(const json_value* v, int* neg, uint64_t* mag) {
+    if (v->flags & JSON_FLAG_UINT64) {
+        *neg = 0;
+        *mag = v->u.ui;
+    } else if (v->flags & JSON_FLAG_INT64) {
+        *neg = v->u.i < 0;
+        *mag = *neg ? 0 - (uint64_t)v->u.i : (uint64_t)v->u.i;
+    } else {
+        double d = v->u.n;
+        if (!(d > -18446744073709551616.0 && d < 18446744073709551616.0)) {
+            return 0;
+        }
+        *neg = d < 0;
+        *mag = (uint64_t)(*neg ? -d : d);
+        if ((double)*mag != (*neg ? -d : d)) { // 有小数部分
+            return 0;
+        }
+    }
+    return 1;
+}
+static int json_is_number_equal(const json_value* lhs, const json_value* rhs) {
+    if (!((lhs->flags | rhs->flags) & JSON_FLAG_INTEGER)) {
+        return lhs->u.n == rhs->u.n;
+    }
+    int lneg, rneg;
+    uint64_t lmag, rmag;
+    if (!json_number_to_uint64(lhs, &lneg, &lmag) || !json_number_to_uint64(rhs, &rneg, &rmag)) {
         return 0;
     }
-    switch (lhs->type) {
-        case JSON_STRING: {
-            return lhs->u.s.len == rhs->u.s.len && memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
-        }
-        case JSON_NUMBER: {
-            return lhs->u.n == rhs->u.n;
+    return lmag == rmag && (lneg == rneg || lmag == 0);
+}
+int json_is_equal(const json_value* lhs, const json_value* rhs) {
+    assert(lhs != NULL && rhs != NULL);
+    json_walk w;
+    json_walk_init(&w);
+    int equal = 1;
+    while (equal) {
+        if (lhs->type != rhs->type) {
+            equal = 0;
+            break;
         }
-        case JSON_ARRAY: {
-            if (lhs->u.a.size != rhs->u.a.size) {
-                return 0;
+        RESOLVE(lhs);
+        RESOLVE(rhs);
+        switch (lhs->type) {
+            case JSON_STRING: {
+                equal = lhs->u.s.len == rhs->u.s.len && memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
+                break;
+            }
+            case JSON_NUMBER: {
+                equal = json_is_number_equal(lhs, rhs);
+                break;
             }
-            for (size_t i = 0; i < lhs->u.a.size; i ++ ) {
-                if (!json_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i])) {
-                    return 0;
+            case JSON_ARRAY:
+            case JSON_OBJECT: {
+                equal = json_walk_size(lhs) == json_walk_size(rhs);
+                if (equal && json_walk_size(lhs) > 0) {
+                    json_walk_push(&w, lhs, (json_value*)rhs);
                 }
+                break;
             }
-            return 1;
-        }
-        case JSON_OBJECT: { // 对象成员顺序不同不影响比较结果
-            if (lhs->u.o.size != rhs->u.o.size) {
-                return 0;
+            default: {
+                break;
             }
-            size_t index;
-            for (size_t i = 0; i < lhs->u.o.size; i ++) {
-                index = json_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen);
-                if (index == JSON_KEY_NOT_EXIST) {
-                    return 0;
-                }
-                if (!json_is_equal(&lhs->u.o.m[i].v, &rhs->u.o.m[index].v)) {
-                    return 0;
+        }
+        lhs = NULL;
+        while (equal && lhs == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                w.depth --;
+            } else if (f->v->type == JSON_ARRAY) {
+                lhs = &f->v->u.a.e[f->i];
+                rhs = &f->w->u.a.e[f->i];
+                f->i ++;
+            } else { // 对象成员顺序不同不影响比较结果
+                const json_member* m = &f->v->u.o.m[f->i];
+                // 成员顺序相同、键来自同一个key pool时不需要查找
+                size_t index = m->k == f->w->u.o.m[f->i].k ? f->i : json_find_object_index(f->w, m->k, m->klen);
+                equal = index != JSON_KEY_NOT_EXIST;
+                if (equal) {
+                    lhs = &m->v;
+                    rhs = &f->w->u.o.m[index].v;
                 }
+                f->i ++;
             }
-            return 1;
         }
-        default: {
-            return 1;
+        if (lhs == NULL) {
+            break;
         }
     }
+    json_walk_free(&w);
+    return equal;
 }
 
 
@@ -563,6 +4015,12 @@ void json_set_boolean(json_value* v, int b) {
 
 double json_get_number(const json_value* v) {
     assert(v != NULL && v->type == JSON_NUMBER);
+    if (v->flags & JSON_FLAG_INT64) {
+        return (double)v->u.i;
+    }
+    if (v->flags & JSON_FLAG_UINT64) {
+        return (double)v->u.ui;
+    }
     return v->u.n;
 }
 void json_set_number(json_value* v, double n) {
@@ -571,18 +4029,72 @@ void json_set_number(json_value* v, double n) {
     v->u.n = n;
 }
 
+int json_is_integer(const json_value* v) {
+    assert(v != NULL);
+    return v->type == JSON_NUMBER && (v->flags & JSON_FLAG_INTEGER) != 0;
+}
+int64_t json_get_int64(const json_value* v) {
+    assert(v != NULL && v->type == JSON_NUMBER);
+    if (v->flags & JSON_FLAG_INT64) {
+        return v->u.i;
+    }
+    if (v->flags & JSON_FLAG_UINT64) {
+        return INT64_MAX;
+    }
+    // double超出int64范围时截断到边界
+    if (v->u.n >= 9223372036854775808.0) {
+        return INT64_MAX;
+    }
+    if (v->u.n < -9223372036854775808.0) {
+        return INT64_MIN;
+    }
+    return isnan(v->u.n) ? 0 : (int64_t)v->u.n;
+}
+void json_set_int64(json_value* v, int64_t i) {
+    json_free(v);
+    v->type = JSON_NUMBER;
+    v->flags = JSON_FLAG_INT64;
+    v->u.i = i;
+}
+uint64_t json_get_uint64(const json_value* v) {
+    assert(v != NULL && v->type == JSON_NUMBER);
+    if (v->flags & JSON_FLAG_UINT64) {
+        return v->u.ui;
+    }
+    if (v->flags & JSON_FLAG_INT64) {
+        return v->u.i < 0 ? 0 : (uint64_t)v->u.i;
+    }
+    if (v->u.n >= 18446744073709551616.0) {
+        return UINT64_MAX;
+    }
+    return v->u.n > 0 ? (uint64_t)v->u.n : 0;
+}
+void json_set_uint64(json_value* v, uint64_t u) {
+    json_free(v);
+    v->type = JSON_NUMBER;
+    if (u <= INT64_MAX) { // 统一用int64保存能表示的值，比较和输出只有一种形式
+        v->flags = JSON_FLAG_INT64;
+        v->u.i = (int64_t)u;
+    } else {
+        v->flags = JSON_FLAG_UINT64;
+        v->u.ui = u;
+    }
+}
+
 const char* json_get_string(const json_value* v) {
     assert(v != NULL && v->type == JSON_STRING);
+    RESOLVE(v);
     return v->u.s.s;
 }
 size_t json_get_string_length(const json_value* v) {
     assert(v != NULL && v->type == JSON_STRING);
+    RESOLVE(v);
     return v->u.s.len;
 }
 void json_set_string(json_value* v, const char* s, size_t len) {
     assert(v != NULL && (s != NULL || len == 0));
     json_free(v);
-    v->u.s.s = (char*)malloc(len + 1);
+    v->u.s.s = (char*)JSON_MALLOC(len + 1);
     memcpy(v->u.s.s, s, len);
     v->u.s.s[len] = '\0';
     v->u.s.len = len;
@@ -596,41 +4108,57 @@ void json_set_array(json_value* v, size_t capacity) {
     v->type = JSON_ARRAY;
     v->u.a.size = 0;
     v->u.a.capacity = capacity;
-    v->u.a.e = capacity > 0 ? (json_value*)malloc(capacity * sizeof(json_value)) : NULL;
+    v->u.a.e = capacity > 0 ? (json_value*)JSON_MALLOC(capacity * sizeof(json_value)) : NULL;
 }
 size_t json_get_array_size(const json_value* v) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    RESOLVE(v);
     return v->u.a.size;
 }
 size_t json_get_array_capacity(const json_value* v) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    RESOLVE(v);
     return v->u.a.capacity;
 }
 void json_reserve_array(json_value* v, size_t capacity) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
     if (v->u.a.capacity < capacity) {
         v->u.a.capacity = capacity;
-        v->u.a.e = (json_value*)realloc(v->u.a.e, capacity * sizeof(json_value));
+        if (v->flags & JSON_FLAG_BORROWED) { // 借用的数组不能realloc，拷贝到自己的内存中
+            json_value* e = (json_value*)JSON_MALLOC(capacity * sizeof(json_value));
+            memcpy(e, v->u.a.e, v->u.a.size * sizeof(json_value));
+            v->u.a.e = e;
+            v->flags &= ~JSON_FLAG_BORROWED;
+        } else {
+            v->u.a.e = (json_value*)JSON_REALLOC(v->u.a.e, capacity * sizeof(json_value));
+        }
     }
 }
 void json_shrink_array(json_value* v) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
     if (v->u.a.capacity > v->u.a.size) {
         v->u.a.capacity = v->u.a.size;
-        v->u.a.e = (json_value*)realloc(v->u.a.e, v->u.a.capacity * sizeof(json_value));
+        if (!(v->flags & JSON_FLAG_BORROWED)) {
+            v->u.a.e = (json_value*)JSON_REALLOC(v->u.a.e, v->u.a.capacity * sizeof(json_value));
+        }
     }
 }
 void json_clear_array(json_value* v) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
     json_erase_array_element(v, 0, v->u.a.size);
 }
 json_value* json_get_array_element(const json_value* v, size_t index) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    RESOLVE(v);
     assert(v->u.a.size > index);
     return &v->u.a.e[index];
 }
 json_value* json_pushback_array_element(json_value* v) {
     assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
     if (v->u.a.size == v->u.a.capacity) {
         json_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
     }
@@ -638,11 +4166,15 @@ json_value* json_pushback_array_element(json_value* v) {
     return &v->u.a.e[v->u.a.size ++];
 }
 void json_popback_array_element(json_value* v) {
-    assert(v != NULL && v->type == JSON_ARRAY && v->u.a.size > 0);
+    assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
+    assert(v->u.a.size > 0);
     json_free(&v->u.a.e[-- v->u.a.size]);
 }
 json_value* json_insert_array_element(json_value* v, size_t index) {
-    assert(v != NULL && v->type == JSON_ARRAY && index <= v->u.a.size);
+    assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
+    assert(index <= v->u.a.size);
     if (v->u.a.size == v->u.a.capacity) {
         json_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
     }
@@ -652,7 +4184,9 @@ json_value* json_insert_array_element(json_value* v, size_t index) {
     return &v->u.a.e[index];
 }
 void json_erase_array_element(json_value* v, size_t index, size_t count) {
-    assert(v != NULL && v->type == JSON_ARRAY && index + count <= v->u.a.size);
+    assert(v != NULL && v->type == JSON_ARRAY);
+    MATERIALIZE(v);
+    assert(index + count <= v->u.a.size);
     for (size_t i = index; i < index + count; i ++) {
         json_free(&v->u.a.e[i]);
     }
@@ -671,57 +4205,100 @@ void json_set_object(json_value* v, size_t capacity) {
     v->type = JSON_OBJECT;
     v->u.o.size = 0;
     v->u.o.capacity = capacity;
-    v->u.o.m = capacity > 0 ? (json_member*)malloc(capacity * sizeof(json_member)) : NULL;
+    v->u.o.m = capacity > 0 ? (json_member*)JSON_MALLOC(capacity * sizeof(json_member)) : NULL;
 }
 size_t json_get_object_size(const json_value* v) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    RESOLVE(v);
     return v->u.o.size;
 }
 size_t json_get_object_capacity(const json_value* v) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    RESOLVE(v);
     return v->u.o.capacity;
 }
+// 重新分配成员数组(以及索引)，索引的位置和大小都取决于capacity，所以每次都要重建
+static void json_object_realloc(json_value* v, size_t capacity, int indexed) {
+    size_t bytes = json_object_bytes(capacity, indexed);
+    if (v->flags & JSON_FLAG_BORROWED) { // 借用的成员数组不能realloc，拷贝到自己的内存中
+        json_member* m = (json_member*)JSON_MALLOC(bytes);
+        memcpy(m, v->u.o.m, v->u.o.size * sizeof(json_member));
+        v->u.o.m = m;
+        v->flags &= ~JSON_FLAG_BORROWED;
+    } else {
+        v->u.o.m = (json_member*)JSON_REALLOC(v->u.o.m, bytes);
+    }
+    v->u.o.capacity = capacity;
+    if (indexed) {
+        v->flags |= JSON_FLAG_INDEXED;
+        json_object_rebuild_index(v);
+    } else {
+        v->flags &= ~JSON_FLAG_INDEXED;
+    }
+}
 void json_reserve_object(json_value* v, size_t capacity) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    MATERIALIZE(v);
     if (v->u.o.capacity < capacity) {
-        v->u.o.capacity = capacity;
-        v->u.o.m = (json_member*)realloc(v->u.o.m, capacity * sizeof(json_member));
+        json_object_realloc(v, capacity, (v->flags & JSON_FLAG_INDEXED) != 0);
     }
 }
 void json_shrink_object(json_value* v) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    MATERIALIZE(v);
     if (v->u.o.capacity > v->u.o.size) {
-        v->u.o.capacity = v->u.o.size;
-        v->u.o.m = (json_member*)realloc(v->u.o.m, v->u.o.capacity * sizeof(json_member));
+        json_object_realloc(v, v->u.o.size, v->u.o.size >= JSON_OBJECT_INDEX_THRESHOLD);
     }
 }
 void json_clear_object(json_value* v) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    MATERIALIZE(v);
     for (size_t i = 0; i < v->u.o.size; i ++) {
-        free(v->u.o.m[i].k);
+        if (!(v->flags & JSON_FLAG_BORROWED_KEYS)) {
+            JSON_FREE(v->u.o.m[i].k);
+        }
         json_free(&v->u.o.m[i].v);
     }
     v->u.o.size = 0;
+    v->flags &= ~JSON_FLAG_BORROWED_KEYS;
+    if (v->flags & JSON_FLAG_INDEXED) {
+        json_object_rebuild_index(v);
+    }
 }
 const char* json_get_object_key(const json_value* v, size_t index) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    RESOLVE(v);
     assert(index < v->u.o.size);
     return v->u.o.m[index].k;
 }
 size_t json_get_object_key_length(const json_value* v, size_t index) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    RESOLVE(v);
     assert(index < v->u.o.size);
     return v->u.o.m[index].klen;
 }
 json_value* json_get_object_value(const json_value* v, size_t index) {
     assert(v != NULL && v->type == JSON_OBJECT);
+    RESOLVE(v);
     assert(index < v->u.o.size);
     return &v->u.o.m[index].v;
 }
 size_t json_find_object_index(const json_value* v, const char* key, size_t klen) {
     assert(v != NULL && v->type == JSON_OBJECT && key != NULL);
-    for (size_t i = 0; i < v->u.o.size; i ++) {
-        if (v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0) {
+    RESOLVE(v);
+    if (v->flags & JSON_FLAG_INDEXED) {
+        const uint32_t* slots = JSON_OBJECT_INDEX(v);
+        size_t mask = json_object_index_slots(v->u.o.capacity) - 1;
+        for (size_t h = json_hash_key(key, klen) & mask; slots[h] != 0; h = (h + 1) & mask) {
+            const json_member* m = &v->u.o.m[slots[h] - 1];
+            if (m->klen == klen && (m->k == key || memcmp(m->k, key, klen) == 0)) {
+                return slots[h] - 1;
+            }
+        }
+        return JSON_KEY_NOT_EXIST;
+    }
+    for (size_t i = 0; i < v->u.o.size; i ++) { // 同一个key pool中的键可以直接比较指针
+        if (v->u.o.m[i].klen == klen && (v->u.o.m[i].k == key || memcmp(v->u.o.m[i].k, key, klen) == 0)) {
             return i;
         }
     }
@@ -729,10 +4306,10 @@ size_t json_find_object_index(const json_value* v, const char* key, size_t klen)
 }
 json_value* json_find_object_value(json_value* v, const char* key, size_t klen) {
     size_t index = json_find_object_index(v, key, klen);
-    return index != JSON_KEY_NOT_EXIST ? &v->u.o.m[index].v : NULL;
+    return index != JSON_KEY_NOT_EXIST ? json_get_object_value(v, index) : NULL;
 }
-json_value* json_set_object_value(json_value* v, const char* key, size_t klen) {
-    assert(v != NULL && v->type == JSON_OBJECT && key != NULL);
+static json_value* json_object_add(json_value* v, const char* key, size_t klen, json_key_pool* pool) {
+    MATERIALIZE(v);
     size_t index = json_find_object_index(v, key, klen);
     if (index != JSON_KEY_NOT_EXIST) {
         return &v->u.o.m[index].v;
@@ -740,17 +4317,690 @@ json_value* json_set_object_value(json_value* v, const char* key, size_t klen) {
     if (v->u.o.size == v->u.o.capacity) {
         json_reserve_object(v, v->u.o.capacity == 0 ? 1 : v->u.o.capacity * 2);
     }
+    // 一个对象中的键要么全部自己分配，要么全部借用，新键和原有的键不一致时先统一原有的键
+    if (pool == NULL && (v->flags & JSON_FLAG_BORROWED_KEYS)) {
+        for (size_t i = 0; i < v->u.o.size; i ++) {
+            char* k = (char*)JSON_MALLOC(v->u.o.m[i].klen + 1);
+            memcpy(k, v->u.o.m[i].k, v->u.o.m[i].klen + 1);
+            v->u.o.m[i].k = k;
+        }
+        v->flags &= ~JSON_FLAG_BORROWED_KEYS;
+    } else if (pool != NULL && !(v->flags & JSON_FLAG_BORROWED_KEYS)) {
+        for (size_t i = 0; i < v->u.o.size; i ++) {
+            char* k = v->u.o.m[i].k;
+            v->u.o.m[i].k = (char*)json_key_pool_intern(pool, k, v->u.o.m[i].klen);
+            JSON_FREE(k);
+        }
+        v->flags |= JSON_FLAG_BORROWED_KEYS;
+    }
     index = v->u.o.size ++;
-    memcpy(v->u.o.m[index].k = (char*)malloc(klen + 1), key, klen);
-    v->u.o.m[index].k[klen] = '\0';
+    if (pool != NULL) {
+        v->u.o.m[index].k = (char*)json_key_pool_intern(pool, key, klen);
+    } else {
+        memcpy(v->u.o.m[index].k = (char*)JSON_MALLOC(klen + 1), key, klen);
+        v->u.o.m[index].k[klen] = '\0';
+    }
     v->u.o.m[index].klen = klen;
     json_init(&v->u.o.m[index].v);
+    if (v->flags & JSON_FLAG_INDEXED) {
+        json_object_index_insert(v, index);
+    } else if (v->u.o.size >= JSON_OBJECT_INDEX_THRESHOLD) { // 对象变大了，建立索引
+        json_object_realloc(v, v->u.o.capacity, 1);
+    }
     return &v->u.o.m[index].v;
 }
+json_value* json_set_object_value(json_value* v, const char* key, size_t klen) {
+    assert(v != NULL && v->type == JSON_OBJECT && key != NULL);
+    return json_object_add(v, key, klen, NULL);
+}
+json_value* json_set_object_value_intern(json_value* v, const char* key, size_t klen, json_key_pool* pool) {
+    assert(v != NULL && v->type == JSON_OBJECT && key != NULL && pool != NULL);
+    return json_object_add(v, key, klen, pool);
+}
 void json_remove_object_value(json_value* v, size_t index) {
-    assert(v != NULL && v->type == JSON_OBJECT && index < v->u.o.size);
-    free(v->u.o.m[index].k);
+    assert(v != NULL && v->type == JSON_OBJECT);
+    MATERIALIZE(v);
+    assert(index < v->u.o.size);
+    if (!(v->flags & JSON_FLAG_BORROWED_KEYS)) {
+        JSON_FREE(v->u.o.m[index].k);
+    }
     json_free(&v->u.o.m[index].v);
     memcpy(&v->u.o.m[index], &v->u.o.m[index + 1], (v->u.o.size - index - 1) * sizeof(json_member));
     v->u.o.size --;
-}
\ No newline at end of file
+    if (v->flags & JSON_FLAG_INDEXED) { // 后面的成员下标都变了
+        json_object_rebuild_index(v);
+    }
+}
+
+
+/* JSON Pointer(RFC 6901)：编译时把路径拆成解码后的键，并预先算出能当作数组下标的值，
+   求值时不再扫描路径字符串 */
+#define JSON_POINTER_NO_INDEX ((size_t)-1) /* 不是合法的数组下标 */
+#define JSON_POINTER_END      ((size_t)-2) /* "-"，数组最后一个元素之后 */
+typedef struct {
+    const char* k;
+    size_t klen;
+    size_t index;
+} json_pointer_token;
+struct json_pointer {
+    size_t count;
+    json_pointer_token* t; // 键的内容紧跟在t之后
+};
+json_pointer* json_pointer_compile(const char* path) {
+    assert(path != NULL);
+    if (*path != '\0' && *path != '/') {
+        return NULL;
+    }
+    size_t count = 0, len = strlen(path);
+    for (const char* p = path; *p != '\0'; p ++) {
+        count += *p == '/';
+    }
+    // 解码后的键不会比原文长，每个键后面加一个'\0'
+    json_pointer* ptr = (json_pointer*)JSON_MALLOC(sizeof(json_pointer) + count * sizeof(json_pointer_token) + len + count);
+    ptr->count = count;
+    ptr->t = (json_pointer_token*)(ptr + 1);
+    char* w = (char*)(ptr->t + count);
+    const char* p = path;
+    for (size_t i = 0; i < count; i ++) {
+        json_pointer_token* t = &ptr->t[i];
+        t->k = w;
+        for (p ++; *p != '\0' && *p != '/'; p ++) {
+            if (*p != '~') {
+                *w ++ = *p;
+            } else if (p[1] == '0' || p[1] == '1') {
+                *w ++ = *++ p == '0' ? '~' : '/';
+            } else {
+                JSON_FREE(ptr);
+                return NULL;
+            }
+        }
+        t->klen = w - t->k;
+        *w ++ = '\0';
+        // 数组下标是"0"或不以0开头的数字
+        t->index = JSON_POINTER_NO_INDEX;
+        if (t->klen == 1 && t->k[0] == '-') {
+            t->index = JSON_POINTER_END;
+        } else if (t->klen > 0 && ISDIGIT(t->k[0]) && (t->k[0] != '0' || t->klen == 1)) {
+            size_t n = 0, j;
+            for (j = 0; j < t->klen && ISDIGIT(t->k[j]) && n < JSON_POINTER_END / 10; j ++) {
+                n = n * 10 + (t->k[j] - '0');
+            }
+            if (j == t->klen) {
+                t->index = n;
+            }
+        }
+    }
+    return ptr;
+}
+void json_pointer_free(json_pointer* ptr) {
+    JSON_FREE(ptr);
+}
+json_value* json_pointer_get(const json_value* v, const json_pointer* ptr) {
+    assert(v != NULL && ptr != NULL);
+    for (size_t i = 0; i < ptr->count; i ++) {
+        const json_pointer_token* t = &ptr->t[i];
+        if (v->type == JSON_OBJECT) {
+            size_t index = json_find_object_index(v, t->k, t->klen);
+            if (index == JSON_KEY_NOT_EXIST) {
+                return NULL;
+            }
+            v = json_get_object_value(v, index);
+        } else if (v->type == JSON_ARRAY && t->index < json_get_array_size(v)) {
+            v = json_get_array_element(v, t->index);
+        } else {
+            return NULL;
+        }
+    }
+    return (json_value*)v;
+}
+json_value* json_pointer_set(json_value* v, const json_pointer* ptr) {
+    assert(v != NULL && ptr != NULL);
+    for (size_t i = 0; i < ptr->count; i ++) {
+        const json_pointer_token* t = &ptr->t[i];
+        if (v->type == JSON_NULL) { // 不存在的中间节点当作对象创建
+            json_set_object(v, 0);
+        }
+        if (v->type == JSON_OBJECT) {
+            v = json_set_object_value(v, t->k, t->klen);
+        } else if (v->type == JSON_ARRAY) {
+            size_t size = json_get_array_size(v);
+            if (t->index < size) {
+                v = json_get_array_element(v, t->index);
+            } else if (t->index == size || t->index == JSON_POINTER_END) {
+                v = json_pushback_array_element(v);
+            } else {
+                return NULL;
+            }
+        } else {
+            return NULL;
+        }
+    }
+    return v;
+}
+// 在文本中沿路径前进到目标值的开头，路径之外的值用json_skip跳过
+static int json_pointer_walk(json_context* c, const json_pointer* ptr) {
+    int ret;
+    for (size_t i = 0; i < ptr->count; i ++) {
+        const json_pointer_token* t = &ptr->t[i];
+        char ch = PEEK(c, c->json);
+        if (ch == '{') {
+            c->json ++;
+            json_parse_whitespace(c);
+            if (PEEK(c, c->json) == '}') {
+                return JSON_PARSE_NOT_FOUND;
+            }
+            for (;;) {
+                char* str;
+                size_t klen;
+                if (PEEK(c, c->json) != '\"') {
+                    return JSON_PARSE_MISS_KEY;
+                }
+                if ((ret = json_parse_string_raw(c, &str, &klen)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+                int found = klen == t->klen && memcmp(str, t->k, klen) == 0;
+                json_parse_whitespace(c);
+                if (PEEK(c, c->json) != ':') {
+                    return JSON_PARSE_MISS_COLON;
+                }
+                c->json ++;
+                json_parse_whitespace(c);
+                if (found) {
+                    break;
+                }
+                if ((ret = json_skip(c)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+                json_parse_whitespace(c);
+                if (PEEK(c, c->json) == ',') {
+                    c->json ++;
+                    json_parse_whitespace(c);
+                } else if (PEEK(c, c->json) == '}') {
+                    return JSON_PARSE_NOT_FOUND;
+                } else {
+                    return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                }
+            }
+        } else if (ch == '[') {
+            c->json ++;
+            json_parse_whitespace(c);
+            if (PEEK(c, c->json) == ']' || t->index >= JSON_POINTER_END) {
+                return JSON_PARSE_NOT_FOUND;
+            }
+            for (size_t n = 0; n < t->index; n ++) {
+                if ((ret = json_skip(c)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+                json_parse_whitespace(c);
+                if (PEEK(c, c->json) == ',') {
+                    c->json ++;
+                    json_parse_whitespace(c);
+                } else if (PEEK(c, c->json) == ']') {
+                    return JSON_PARSE_NOT_FOUND;
+                } else {
+                    return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                }
+            }
+        } else { // 标量或字符串没有子节点
+            return (ret = json_skip(c)) != JSON_PARSE_OK ? ret : JSON_PARSE_NOT_FOUND;
+        }
+    }
+    return JSON_PARSE_OK;
+}
+int json_pointer_find(json_value* v, const char* json, size_t len, const json_pointer* ptr) {
+    assert(v != NULL && ptr != NULL && (json != NULL || len == 0));
+    json_context c;
+    json_context_init(&c, json, len);
+    json_init(v);
+    json_parse_whitespace(&c);
+    int ret = json_pointer_walk(&c, ptr);
+    if (ret == JSON_PARSE_OK) {
+        ret = json_parse_value(&c, v);
+    }
+    JSON_FREE(c.stack);
+    return ret;
+}
+
+
+
+/* 平坦格式：整棵树写在一块连续的内存中，用相对于开头的偏移代替指针，可以直接mmap只读访问。
+   每个值是16字节的json_flat_slot；字符串块是长度+内容+'\0'；数组块是元素个数+元素；
+   对象块是成员个数+成员(键的偏移和值)+按键排序的成员下标，相同的键共用一个字符串块。所有块按8字节对齐 */
+#define JSON_FLAT_MAGIC "xscJflat"
+#define JSON_FLAT_VERSION 1
+#define JSON_FLAT_ALIGN(n) (((n) + 7) & ~(size_t)7)
+typedef struct {
+    uint32_t type;
+    uint32_t flags; // 只有JSON_FLAG_INT64/JSON_FLAG_UINT64
+    union { double n; int64_t i; uint64_t ui; uint64_t off; } u;
+} json_flat_slot;
+typedef struct {
+    uint64_t koff;
+    json_flat_slot v;
+} json_flat_member;
+typedef struct {
+    char magic[8];
+    uint32_t byte_order; // 写入时为0x01020304，字节序不同的机器上读出来不相等
+    uint32_t version;
+    uint64_t length;
+    json_flat_slot root;
+} json_flat_header;
+
+#define JSON_FLAT_AT(c, off, type) ((type*)((c)->stack + (off)))
+static size_t json_flat_put_block(json_context* c, size_t size) {
+    size_t off = c->top;
+    memset(json_context_push(c, JSON_FLAT_ALIGN(size)), 0, JSON_FLAT_ALIGN(size));
+    return off;
+}
+static size_t json_flat_put_string(json_context* c, const char* s, size_t len) {
+    size_t off = json_flat_put_block(c, sizeof(uint64_t) + len + 1);
+    *JSON_FLAT_AT(c, off, uint64_t) = len;
+    memcpy(c->stack + off + sizeof(uint64_t), s, len);
+    return off;
+}
+// 相同的键只写一次：记录已经写过的键块的偏移，开放寻址，偏移0(头部)表示空位
+typedef struct {
+    uint64_t* slots;
+    size_t size, capacity;
+} json_flat_keys;
+static size_t json_flat_put_key(json_context* c, json_flat_keys* keys, const char* k, size_t klen) {
+    if (keys->size * 2 >= keys->capacity) {
+        json_flat_keys t;
+        t.capacity = keys->capacity == 0 ? 64 : keys->capacity * 2;
+        t.slots = (uint64_t*)JSON_CALLOC(t.capacity, sizeof(uint64_t));
+        for (size_t i = 0; i < keys->capacity; i ++) {
+            if (keys->slots[i] != 0) {
+                const char* old = c->stack + keys->slots[i];
+                size_t h = json_hash_key(old + sizeof(uint64_t), *(const uint64_t*)old) & (t.capacity - 1);
+                while (t.slots[h] != 0) {
+                    h = (h + 1) & (t.capacity - 1);
+                }
+                t.slots[h] = keys->slots[i];
+            }
+        }
+        JSON_FREE(keys->slots);
+        keys->slots = t.slots;
+        keys->capacity = t.capacity;
+    }
+    size_t h = json_hash_key(k, klen) & (keys->capacity - 1);
+    for (; keys->slots[h] != 0; h = (h + 1) & (keys->capacity - 1)) {
+        const char* old = c->stack + keys->slots[h];
+        if (*(const uint64_t*)old == klen && memcmp(old + sizeof(uint64_t), k, klen) == 0) {
+            return keys->slots[h];
+        }
+    }
+    keys->size ++;
+    return keys->slots[h] = json_flat_put_string(c, k, klen);
+}
+// 按字节比较键，查找时用同样的顺序二分
+static int json_flat_key_less(const json_member* a, const json_member* b) {
+    size_t n = a->klen < b->klen ? a->klen : b->klen;
+    int r = memcmp(a->k, b->k, n);
+    return r < 0 || (r == 0 && a->klen < b->klen);
+}
+// 写入v引用的块，把v的槽写到slot偏移处；c->stack可能被realloc，所以只保存偏移
+static void json_flat_put_value(json_context* c, json_flat_keys* keys, size_t slot, const json_value* v) {
+    json_walk w;
+    json_walk_init(&w);
+    for (;;) {
+        RESOLVE(v);
+        json_flat_slot s;
+        memset(&s, 0, sizeof(s));
+        s.type = v->type;
+        switch (v->type) {
+            case JSON_NUMBER: {
+                s.flags = v->flags & JSON_FLAG_INTEGER;
+                if (v->flags & JSON_FLAG_UINT64) {
+                    s.u.ui = v->u.ui;
+                } else if (v->flags & JSON_FLAG_INT64) {
+                    s.u.i = v->u.i;
+                } else {
+                    s.u.n = v->u.n;
+                }
+                break;
+            }
+            case JSON_STRING: s.u.off = json_flat_put_string(c, v->u.s.s, v->u.s.len); break;
+            case JSON_ARRAY: { // 元素的槽在遍历到时再写
+                size_t n = v->u.a.size;
+                s.u.off = json_flat_put_block(c, sizeof(uint64_t) + n * sizeof(json_flat_slot));
+                *JSON_FLAT_AT(c, s.u.off, uint64_t) = n;
+                if (n > 0) {
+                    json_walk_push(&w, v, NULL)->off = s.u.off;
+                }
+                break;
+            }
+            case JSON_OBJECT: {
+                size_t n = v->u.o.size;
+                assert(n <= UINT32_MAX);
+                size_t sorted = sizeof(uint64_t) + n * sizeof(json_flat_member);
+                s.u.off = json_flat_put_block(c, sorted + n * sizeof(uint32_t));
+                *JSON_FLAT_AT(c, s.u.off, uint64_t) = n;
+                uint32_t* idx = (uint32_t*)JSON_MALLOC(n * 2 * sizeof(uint32_t) + 1);
+                for (size_t i = 0; i < n; i ++) {
+                    idx[i] = (uint32_t)i;
+                }
+                json_sort_members(idx, idx + n, n, v->u.o.m, json_flat_key_less); // 重复的键保持原来的先后顺序，查找时找到第一个
+                memcpy(c->stack + s.u.off + sorted, idx, n * sizeof(uint32_t));
+                JSON_FREE(idx);
+                if (n > 0) {
+                    json_walk_push(&w, v, NULL)->off = s.u.off;
+                }
+                break;
+            }
+            default: break;
+        }
+        memcpy(c->stack + slot, &s, sizeof(s));
+        v = NULL;
+        while (v == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            if (f->i == json_walk_size(f->v)) {
+                w.depth --;
+            } else if (f->v->type == JSON_ARRAY) {
+                slot = f->off + sizeof(uint64_t) + f->i * sizeof(json_flat_slot);
+                v = &f->v->u.a.e[f->i ++];
+            } else { // 成员的键在值之前写入
+                const json_member* m = &f->v->u.o.m[f->i];
+                size_t moff = f->off + sizeof(uint64_t) + f->i ++ * sizeof(json_flat_member);
+                size_t koff = json_flat_put_key(c, keys, m->k, m->klen);
+                JSON_FLAT_AT(c, moff, json_flat_member)->koff = koff;
+                slot = moff + offsetof(json_flat_member, v);
+                v = &m->v;
+            }
+        }
+        if (v == NULL) {
+            break;
+        }
+    }
+    json_walk_free(&w);
+}
+char* json_flat_build(const json_value* v, size_t* length) {
+    assert(v != NULL && length != NULL);
+    json_context c;
+    json_context_init(&c, NULL, 0);
+    c.stack = (char*)JSON_MALLOC(c.size = JSON_STRINGIFY_STACK_INIT_SIZE);
+    json_flat_keys keys = { NULL, 0, 0 };
+    size_t off = json_flat_put_block(&c, sizeof(json_flat_header));
+    json_flat_put_value(&c, &keys, off + offsetof(json_flat_header, root), v);
+    JSON_FREE(keys.slots);
+    json_flat_header* h = JSON_FLAT_AT(&c, off, json_flat_header);
+    memcpy(h->magic, JSON_FLAT_MAGIC, sizeof(h->magic));
+    h->byte_order = 0x01020304;
+    h->version = JSON_FLAT_VERSION;
+    h->length = c.top;
+    *length = c.top;
+    return c.stack;
+}
+// off处字符串块的结束位置(按8字节对齐)；越界、没有对齐或者不以'\0'结尾时返回0
+static size_t json_flat_string_end(const char* base, size_t len, uint64_t off) {
+    if (off < sizeof(json_flat_header) || (off & 7) != 0 || off > len || len - off < sizeof(uint64_t) + 1) {
+        return 0;
+    }
+    uint64_t n = *(const uint64_t*)(base + off);
+    if (n > len - off - sizeof(uint64_t) - 1 || base[off + sizeof(uint64_t) + n] != '\0') {
+        return 0;
+    }
+    size_t size = JSON_FLAT_ALIGN(sizeof(uint64_t) + (size_t)n + 1);
+    return size <= len - off ? off + size : 0;
+}
+/* 打开时的边界检查，O(n)：json_flat_build按先序遍历的顺序依次写出值的块，所以每个值的块都必须在前一个块之后，
+   子块不会与父块重叠、也不会指回祖先，每个块只检查一次；键的块可以与前面的键共用，只检查它本身不越界 */
+static int json_flat_verify(const char* base, size_t len) {
+    json_walk w;
+    size_t pos = sizeof(json_flat_header), slot = offsetof(json_flat_header, root); // pos：下一个值块最早可以开始的位置
+    int ok = 1;
+    json_walk_init(&w);
+    while (ok) {
+        const json_flat_slot* s = (const json_flat_slot*)(base + slot);
+        uint64_t off = s->u.off;
+        switch (s->type) {
+            case JSON_NULL: case JSON_FALSE: case JSON_TRUE: break;
+            case JSON_NUMBER: ok = (s->flags & ~JSON_FLAG_INTEGER) == 0 && s->flags != JSON_FLAG_INTEGER; break;
+            case JSON_STRING: ok = off >= pos && (pos = json_flat_string_end(base, len, off)) != 0; break;
+            case JSON_ARRAY:
+            case JSON_OBJECT: {
+                size_t unit = s->type == JSON_ARRAY ? sizeof(json_flat_slot) : sizeof(json_flat_member) + sizeof(uint32_t);
+                if (off < pos || (off & 7) != 0 || off > len - sizeof(uint64_t)) {
+                    ok = 0;
+                    break;
+                }
+                uint64_t n = *(const uint64_t*)(base + off);
+                size_t size;
+                if (n > (len - off - sizeof(uint64_t)) / unit || (size = JSON_FLAT_ALIGN(sizeof(uint64_t) + (size_t)n * unit)) > len - off) {
+                    ok = 0;
+                    break;
+                }
+                if (s->type == JSON_OBJECT) { // 二分查找用的下标
+                    const uint32_t* sorted = (const uint32_t*)(base + off + sizeof(uint64_t) + n * sizeof(json_flat_member));
+                    for (size_t i = 0; i < n && ok; i ++) {
+                        ok = sorted[i] < n;
+                    }
+                }
+                pos = off + size;
+                if (n > 0 && ok) {
+                    json_walk_push(&w, NULL, NULL)->off = slot;
+                }
+                break;
+            }
+            default: ok = 0;
+        }
+        // 下一个槽，对象成员先检查键
+        slot = 0;
+        while (ok && slot == 0 && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            const json_flat_slot* p = (const json_flat_slot*)(base + f->off);
+            if (f->i == *(const uint64_t*)(base + p->u.off)) {
+                w.depth --;
+            } else if (p->type == JSON_ARRAY) {
+                slot = p->u.off + sizeof(uint64_t) + f->i ++ * sizeof(json_flat_slot);
+            } else {
+                size_t moff = p->u.off + sizeof(uint64_t) + f->i ++ * sizeof(json_flat_member);
+                uint64_t koff = ((const json_flat_member*)(base + moff))->koff;
+                size_t end = json_flat_string_end(base, len, koff);
+                if (end == 0) {
+                    ok = 0;
+                } else if (koff >= pos) { // 第一次出现的键
+                    pos = end;
+                }
+                slot = moff + offsetof(json_flat_member, v);
+            }
+        }
+        if (slot == 0) {
+            break;
+        }
+    }
+    json_walk_free(&w);
+    return ok;
+}
+static int json_flat_open_header(json_flat* root, const void* data, size_t len) {
+    assert(root != NULL && (data != NULL || len == 0));
+    const json_flat_header* h = (const json_flat_header*)data;
+    root->base = root->slot = NULL;
+    if (len < sizeof(json_flat_header) || ((uintptr_t)data & 7) != 0) {
+        return JSON_PARSE_INVALID_FLAT;
+    }
+    if (memcmp(h->magic, JSON_FLAT_MAGIC, sizeof(h->magic)) != 0 || h->byte_order != 0x01020304
+        || h->version != JSON_FLAT_VERSION || h->length != len) {
+        return JSON_PARSE_INVALID_FLAT;
+    }
+    root->base = (const char*)data;
+    root->slot = &h->root;
+    return JSON_PARSE_OK;
+}
+int json_flat_open(json_flat* root, const void* data, size_t len) {
+    int ret = json_flat_open_header(root, data, len);
+    if (ret == JSON_PARSE_OK && !json_flat_verify((const char*)data, len)) {
+        root->base = root->slot = NULL;
+        ret = JSON_PARSE_INVALID_FLAT;
+    }
+    return ret;
+}
+int json_flat_open_unchecked(json_flat* root, const void* data, size_t len) {
+    return json_flat_open_header(root, data, len);
+}
+#define FLAT_SLOT(f) ((const json_flat_slot*)(f).slot)
+#define FLAT_BLOCK(f) ((f).base + FLAT_SLOT(f)->u.off)
+static json_flat json_flat_make(const char* base, const json_flat_slot* slot) {
+    json_flat f;
+    f.base = base;
+    f.slot = slot;
+    return f;
+}
+json_type json_flat_get_type(json_flat f) {
+    assert(f.slot != NULL);
+    return (json_type)FLAT_SLOT(f)->type;
+}
+int json_flat_get_boolean(json_flat f) {
+    assert(f.slot != NULL && (FLAT_SLOT(f)->type == JSON_TRUE || FLAT_SLOT(f)->type == JSON_FALSE));
+    return FLAT_SLOT(f)->type == JSON_TRUE;
+}
+// 数字的槽和json_value中的数字一样，转换规则直接复用json_get_*
+static json_value json_flat_number(json_flat f) {
+    assert(f.slot != NULL && FLAT_SLOT(f)->type == JSON_NUMBER);
+    json_value v;
+    v.type = JSON_NUMBER;
+    v.flags = FLAT_SLOT(f)->flags;
+    v.u.ui = FLAT_SLOT(f)->u.ui;
+    return v;
+}
+double json_flat_get_number(json_flat f) {
+    json_value v = json_flat_number(f);
+    return json_get_number(&v);
+}
+int json_flat_is_integer(json_flat f) {
+    json_value v = json_flat_number(f);
+    return json_is_integer(&v);
+}
+int64_t json_flat_get_int64(json_flat f) {
+    json_value v = json_flat_number(f);
+    return json_get_int64(&v);
+}
+uint64_t json_flat_get_uint64(json_flat f) {
+    json_value v = json_flat_number(f);
+    return json_get_uint64(&v);
+}
+const char* json_flat_get_string(json_flat f) {
+    assert(f.slot != NULL && FLAT_SLOT(f)->type == JSON_STRING);
+    return FLAT_BLOCK(f) + sizeof(uint64_t);
+}
+size_t json_flat_get_string_length(json_flat f) {
+    assert(f.slot != NULL && FLAT_SLOT(f)->type == JSON_STRING);
+    return (size_t)*(const uint64_t*)FLAT_BLOCK(f);
+}
+size_t json_flat_get_array_size(json_flat f) {
+    assert(f.slot != NULL && FLAT_SLOT(f)->type == JSON_ARRAY);
+    return (size_t)*(const uint64_t*)FLAT_BLOCK(f);
+}
+json_flat json_flat_get_array_element(json_flat f, size_t index) {
+    assert(index < json_flat_get_array_size(f));
+    return json_flat_make(f.base, (const json_flat_slot*)(FLAT_BLOCK(f) + sizeof(uint64_t)) + index);
+}
+size_t json_flat_get_object_size(json_flat f) {
+    assert(f.slot != NULL && FLAT_SLOT(f)->type == JSON_OBJECT);
+    return (size_t)*(const uint64_t*)FLAT_BLOCK(f);
+}
+static const json_flat_member* json_flat_member_at(json_flat f, size_t index) {
+    assert(index < json_flat_get_object_size(f));
+    return (const json_flat_member*)(FLAT_BLOCK(f) + sizeof(uint64_t)) + index;
+}
+const char* json_flat_get_object_key(json_flat f, size_t index) {
+    return f.base + json_flat_member_at(f, index)->koff + sizeof(uint64_t);
+}
+size_t json_flat_get_object_key_length(json_flat f, size_t index) {
+    return (size_t)*(const uint64_t*)(f.base + json_flat_member_at(f, index)->koff);
+}
+json_flat json_flat_get_object_value(json_flat f, size_t index) {
+    return json_flat_make(f.base, &json_flat_member_at(f, index)->v);
+}
+size_t json_flat_find_object_index(json_flat f, const char* key, size_t klen) {
+    assert(key != NULL);
+    size_t n = json_flat_get_object_size(f);
+    const json_flat_member* m = (const json_flat_member*)(FLAT_BLOCK(f) + sizeof(uint64_t));
+    const uint32_t* sorted = (const uint32_t*)(m + n);
+    size_t lo = 0, hi = n;
+    while (lo < hi) { // 第一个不小于key的成员
+        size_t mid = lo + (hi - lo) / 2;
+        const char* k = f.base + m[sorted[mid]].koff;
+        size_t len = (size_t)*(const uint64_t*)k;
+        int r = memcmp(k + sizeof(uint64_t), key, len < klen ? len : klen);
+        if (r < 0 || (r == 0 && len < klen)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < n && json_flat_get_object_key_length(f, sorted[lo]) == klen
+        && memcmp(json_flat_get_object_key(f, sorted[lo]), key, klen) == 0) {
+        return sorted[lo];
+    }
+    return JSON_KEY_NOT_EXIST;
+}
+json_flat json_flat_find_object_value(json_flat f, const char* key, size_t klen) {
+    size_t index = json_flat_find_object_index(f, key, klen);
+    return index != JSON_KEY_NOT_EXIST ? json_flat_get_object_value(f, index) : json_flat_make(NULL, NULL);
+}
+void json_flat_copy(json_value* dst, json_flat src) {
+    assert(dst != NULL && src.slot != NULL);
+    json_walk w;
+    json_walk_init(&w);
+    for (;;) {
+        const json_flat_slot* s = FLAT_SLOT(src);
+        switch (s->type) {
+            case JSON_NUMBER: json_free(dst); *dst = json_flat_number(src); break;
+            case JSON_STRING: json_set_string(dst, json_flat_get_string(src), json_flat_get_string_length(src)); break;
+            case JSON_ARRAY: { // 元素在遍历到时再拷贝，源的位置用槽相对于开头的偏移记录
+                size_t n = json_flat_get_array_size(src);
+                json_set_array(dst, n);
+                if (n > 0) {
+                    json_walk_push(&w, NULL, dst)->off = (const char*)s - src.base;
+                }
+                break;
+            }
+            case JSON_OBJECT: { // 成员按原来的顺序拷贝，键可能重复，所以不用json_set_object_value
+                size_t n = json_flat_get_object_size(src);
+                json_set_object(dst, n);
+                if (n > 0) {
+                    json_walk_push(&w, NULL, dst)->off = (const char*)s - src.base;
+                }
+                break;
+            }
+            default: {
+                json_free(dst);
+                dst->type = (json_type)s->type;
+                break;
+            }
+        }
+        dst = NULL;
+        while (dst == NULL && w.depth > 0) {
+            json_walk_frame* f = &w.f[w.depth - 1];
+            json_flat p = json_flat_make(src.base, (const json_flat_slot*)(src.base + f->off));
+            if (f->w->type == JSON_ARRAY) {
+                if (f->i == f->w->u.a.capacity) {
+                    w.depth --;
+                } else {
+                    src = json_flat_get_array_element(p, f->i);
+                    dst = &f->w->u.a.e[f->i ++];
+                    json_init(dst);
+                    f->w->u.a.size = f->i;
+                }
+            } else if (f->i == f->w->u.o.capacity) {
+                if (f->i >= JSON_OBJECT_INDEX_THRESHOLD) {
+                    json_object_realloc(f->w, f->i, 1);
+                }
+                w.depth --;
+            } else {
+                json_member* m = &f->w->u.o.m[f->i];
+                m->klen = json_flat_get_object_key_length(p, f->i);
+                m->k = (char*)JSON_MALLOC(m->klen + 1);
+                memcpy(m->k, json_flat_get_object_key(p, f->i), m->klen + 1);
+                json_init(&m->v);
+                src = json_flat_get_object_value(p, f->i ++);
+                f->w->u.o.size = f->i;
+                dst = &m->v;
+            }
+        }
+        if (dst == NULL) {
+            break;
+        }
+    }
+    json_walk_free(&w);
+}
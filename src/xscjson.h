@@ -2,6 +2,7 @@
 #define __XSCJSON_H__
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum { 
     JSON_NULL, JSON_FALSE, JSON_TRUE, 
@@ -18,8 +19,11 @@ struct json_value {
         struct { json_value* e; size_t size, capacity; } a;
         struct { char* s; size_t len; } s;
         double n;
+        int64_t i;
+        uint64_t ui;
     } u;
     json_type type;
+    unsigned flags; /* 存储归属等内部标记，由库维护 */
 };
 
 struct json_member {
@@ -43,18 +47,162 @@ enum {
     JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     JSON_PARSE_MISS_KEY,
     JSON_PARSE_MISS_COLON,
-    JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    JSON_PARSE_STOPPED,
+    JSON_PARSE_NOT_FOUND,
+    JSON_PARSE_INVALID_CBOR,
+    JSON_PARSE_INVALID_FLAT,
+    JSON_PARSE_TOO_DEEP
 };
 
 
 
-#define json_init(v) do { (v)->type = JSON_NULL; } while(0)
+#define json_init(v) do { (v)->type = JSON_NULL; (v)->flags = 0; } while(0)
 
 void json_free(json_value* v);
 
+// 内存分配函数，ud原样传回；realloc和free不会收到NULL
+typedef struct {
+    void* (*malloc)(void* ud, size_t size);
+    void* (*realloc)(void* ud, void* ptr, size_t size);
+    void (*free)(void* ud, void* ptr);
+    void* ud;
+} json_allocator;
+
+// 设置库使用的全局分配器，NULL恢复为标准库；只能在库没有持有任何内存时调用
+void json_set_allocator(const json_allocator* a);
+const json_allocator* json_get_allocator(void);
+// 释放json_stringify、json_stringify_ex、json_to_cbor、json_flat_build返回的缓冲区
+void json_free_buffer(void* p);
+
+// 数组、对象嵌套超过depth层时解析失败，返回JSON_PARSE_TOO_DEEP；0表示不限制
+void json_set_max_depth(size_t depth);
+size_t json_get_max_depth(void);
+
+// 解析引擎，对建立json_value树的解析函数生效；两种引擎的结果和错误码完全相同
+typedef enum {
+    JSON_ENGINE_RECURSIVE, // 递归下降，逐字节解析(默认)
+    JSON_ENGINE_INDEXED    // 两阶段：先用SIMD建立结构字符的索引，再按索引建立树
+} json_engine;
+
+void json_set_engine(json_engine engine);
+json_engine json_get_engine(void);
+
 int json_parse(json_value* v, const char* json);
+int json_parse_n(json_value* v, const char* json, size_t len);
+
+#define JSON_PARSE_ERROR_PATH_SIZE 256
+typedef struct {
+    size_t offset; // 出错的字符相对于输入开头的字节偏移
+    size_t line, column; // 从1开始，列按字节计算
+    char path[JSON_PARSE_ERROR_PATH_SIZE]; // 出错的值在文档中的位置，例如$.items[42].name
+} json_parse_error;
+
+int json_parse_ex(json_value* v, const char* json, size_t len, json_parse_error* err);
+
+// 可以重复使用的解析器，解析栈留到下一次解析，不能同时在多个线程中使用
+typedef struct {
+    char* stack;
+    size_t stack_size;
+    // 只用来分配解析栈这样的临时内存，init时复制全局分配器，之后可以修改；解析出的值仍由全局分配器分配，
+    // 需要整个文档使用别的分配器时用json_parse_arena
+    json_allocator scratch_allocator;
+} json_parser;
+
+void json_parser_init(json_parser* p);
+void json_parser_free(json_parser* p);
+int json_parser_parse(json_parser* p, json_value* v, const char* json, size_t len, json_parse_error* err);
+int json_parse_insitu(json_value* v, char* buf);
+// 延迟解析：访问函数第一次读到数组、对象、字符串时才解析，结果缓存在这个值单独分配的单元中，
+// const的值本身不会被改写；缓存仍是修改，所以即使只读，同一个延迟解析的文档也不能同时在多个线程中访问
+int json_parse_lazy(json_value* v, const char* json, size_t len);
+int json_parse_keys(json_value* v, const char* json, size_t len, const char* const* keys);
+int json_skip_value(const char* json, size_t len, size_t* skipped);
+
+typedef struct json_arena_block json_arena_block;
+typedef struct {
+    json_arena_block* head;
+    json_arena_block* cur;
+    size_t block_size;
+    char* stack;
+    size_t stack_size;
+    json_allocator allocator; // 块和解析栈的分配器，init时复制全局分配器，之后可以修改
+} json_arena;
+
+void json_arena_init(json_arena* a, size_t block_size);
+void json_arena_reset(json_arena* a);
+void json_arena_free(json_arena* a);
+int json_parse_arena(json_value* v, const char* json, json_arena* a);
+
+typedef struct json_key_entry json_key_entry;
+typedef struct {
+    json_arena keys;
+    json_key_entry* slots;
+    size_t size, capacity;
+} json_key_pool;
+
+void json_key_pool_init(json_key_pool* pool);
+void json_key_pool_free(json_key_pool* pool);
+const char* json_key_pool_intern(json_key_pool* pool, const char* key, size_t klen);
+int json_parse_intern(json_value* v, const char* json, json_key_pool* pool);
+
+// SAX回调，返回0时停止解析；不需要的事件可以设为NULL
+typedef struct {
+    int (*null_value)(void* ud);
+    int (*boolean)(void* ud, int b);
+    int (*number)(void* ud, const json_value* n);
+    int (*string)(void* ud, const char* s, size_t len);
+    int (*start_object)(void* ud);
+    int (*key)(void* ud, const char* k, size_t klen);
+    int (*end_object)(void* ud, size_t size);
+    int (*start_array)(void* ud);
+    int (*end_array)(void* ud, size_t size);
+} json_sax_handler;
+
+int json_sax_parse(const char* json, size_t len, const json_sax_handler* h, void* ud);
+
+typedef struct json_stream json_stream;
+
+json_stream* json_stream_new(json_value* v);
+json_stream* json_stream_new_sax(const json_sax_handler* h, void* ud);
+int json_stream_feed(json_stream* s, const char* chunk, size_t len);
+int json_stream_finish(json_stream* s);
+void json_stream_free(json_stream* s);
+
+// NDJSON回调，按记录顺序在调用者线程中调用；ret不为JSON_PARSE_OK时v为null，返回0时停止
+typedef int (*json_ndjson_callback)(void* ud, size_t line, int ret, json_value* v);
+
+int json_parse_ndjson(const char* json, size_t len, unsigned threads, json_ndjson_callback cb, void* ud);
 char* json_stringify(const json_value* v, size_t* length);
 
+enum {
+    JSON_STRINGIFY_SORT_KEYS = 0x1, // 对象成员按键排序(RFC 8785的顺序)，控制字符的转义用小写十六进制
+    JSON_STRINGIFY_ASCII     = 0x2, // 非ASCII字符写成\uXXXX
+    JSON_STRINGIFY_PRESIZE   = 0x4  // 先计算输出长度，缓冲区只分配一次
+};
+
+char* json_stringify_ex(const json_value* v, size_t* length, unsigned flags, unsigned indent);
+
+// 输出回调，返回0时停止输出
+typedef int (*json_writer_fn)(void* ud, const char* data, size_t len);
+
+int json_stringify_to(const json_value* v, json_writer_fn writer, void* ud);
+
+// 可以重复使用的生成器，输出缓冲区留到下一次生成，不能同时在多个线程中使用
+typedef struct {
+    char* buffer;
+    size_t size;
+    // 只用来分配输出缓冲区，init时复制全局分配器，之后可以修改；排序键和深层遍历的临时内存仍由全局分配器分配
+    json_allocator scratch_allocator;
+} json_writer;
+
+void json_writer_init(json_writer* w);
+void json_writer_free(json_writer* w);
+const char* json_writer_stringify(json_writer* w, const json_value* v, size_t* length, unsigned flags, unsigned indent);
+int json_writer_stringify_to(json_writer* w, const json_value* v, json_writer_fn writer, void* ud);
+char* json_to_cbor(const json_value* v, size_t* length);
+int json_from_cbor(json_value* v, const char* data, size_t len);
+
 void json_copy(json_value* dst, const json_value* src);
 void json_move(json_value* dst, json_value* src);
 void json_swap(json_value* lhs, json_value* rhs);
@@ -71,6 +219,12 @@ void json_set_boolean(json_value* v, int b);
 double json_get_number(const json_value* v);
 void json_set_number(json_value* v, double n);
 
+int json_is_integer(const json_value* v);
+int64_t json_get_int64(const json_value* v);
+void json_set_int64(json_value* v, int64_t i);
+uint64_t json_get_uint64(const json_value* v);
+void json_set_uint64(json_value* v, uint64_t u);
+
 const char* json_get_string(const json_value* v);
 size_t json_get_string_length(const json_value* v);
 void json_set_string(json_value* v, const char* s, size_t len);
@@ -100,6 +254,44 @@ json_value* json_get_object_value(const json_value* v, size_t index);
 size_t json_find_object_index(const json_value* v, const char* key, size_t klen);
 json_value* json_find_object_value(json_value* v, const char* key, size_t klen);
 json_value* json_set_object_value(json_value* v, const char* key, size_t klen);
+json_value* json_set_object_value_intern(json_value* v, const char* key, size_t klen, json_key_pool* pool);
 void json_remove_object_value(json_value* v, size_t index);
 
+typedef struct json_pointer json_pointer;
+
+json_pointer* json_pointer_compile(const char* path);
+void json_pointer_free(json_pointer* ptr);
+json_value* json_pointer_get(const json_value* v, const json_pointer* ptr);
+json_value* json_pointer_set(json_value* v, const json_pointer* ptr);
+int json_pointer_find(json_value* v, const char* json, size_t len, const json_pointer* ptr);
+
+// 平坦格式中的一个值，base是整块数据的开头
+typedef struct {
+    const char* base;
+    const void* slot;
+} json_flat;
+
+char* json_flat_build(const json_value* v, size_t* length);
+// 检查头部并遍历一遍，保证所有偏移都在data之内，被截断或损坏的数据返回JSON_PARSE_INVALID_FLAT
+int json_flat_open(json_flat* root, const void* data, size_t len);
+// 快速路径：只检查头部，O(1)；data必须是可信的json_flat_build输出，损坏的数据会让访问函数越界读取
+int json_flat_open_unchecked(json_flat* root, const void* data, size_t len);
+void json_flat_copy(json_value* dst, json_flat src);
+json_type json_flat_get_type(json_flat f);
+int json_flat_get_boolean(json_flat f);
+double json_flat_get_number(json_flat f);
+int json_flat_is_integer(json_flat f);
+int64_t json_flat_get_int64(json_flat f);
+uint64_t json_flat_get_uint64(json_flat f);
+const char* json_flat_get_string(json_flat f);
+size_t json_flat_get_string_length(json_flat f);
+size_t json_flat_get_array_size(json_flat f);
+json_flat json_flat_get_array_element(json_flat f, size_t index);
+size_t json_flat_get_object_size(json_flat f);
+const char* json_flat_get_object_key(json_flat f, size_t index);
+size_t json_flat_get_object_key_length(json_flat f, size_t index);
+json_flat json_flat_get_object_value(json_flat f, size_t index);
+size_t json_flat_find_object_index(json_flat f, const char* key, size_t klen);
+json_flat json_flat_find_object_value(json_flat f, const char* key, size_t klen);
+
 #endif /* __XSCJSON_H__ */
\ No newline at end of file